@@ -7,19 +7,23 @@
 
 #include <dune/grid/common/mcmgmapper.hh> // mapper class
 #include <dune/common/parallel/mpihelper.hh> // include mpi helper class
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
 
-#include "vtkout.hh"
+#include "asyncvtkout.hh"
 #include "transportproblem2.hh"
 #include "initialize.hh"
 #include "evolve.hh"
 #include "finitevolumeadapt.hh"
+#include "adaptstatistics.hh"
 
 //===============================================================
 // the time loop function working for all types of grids
 //===============================================================
 
 template<class G>
-void timeloop (G& grid, double tend, int lmin, int lmax)
+void timeloop (G& grid, double tend, int lmin, int lmax, VTKOutputFormat format,
+               bool async)
 {
   // make a mapper for codim 0 entities in the leaf grid
   Dune::LeafMultipleCodimMultipleGeomTypeMapper<G>
@@ -28,17 +32,31 @@ void timeloop (G& grid, double tend, int lmin, int lmax)
   // allocate a vector for the concentration
   std::vector<double> c(mapper.size());
 
+  // memory and time accounting of the grid adaptation, one line with
+  // k=0 per step of the initial refinement, or one line with the element
+  // counts of the initial grid if it is not refined
+  AdaptStatistics stats;
+  stats.countElements(grid);
+  int initialSteps = 0;
+
   // initialize concentration with initial values
   initialize(grid,mapper,c);
   for (int i=grid.maxLevel(); i<lmax; i++)
   {
     if (grid.maxLevel()>=lmax) break;
-    finitevolumeadapt(grid,mapper,c,lmin,lmax,0);           /*@\label{afv:in}@*/
+    finitevolumeadapt(grid,mapper,c,lmin,lmax,0,&stats);    /*@\label{afv:in}@*/
+    adaptstatsout(stats,"concentration",0,0,0,initialSteps==0);
+    ++initialSteps;
     initialize(grid,mapper,c);
   }
+  if (initialSteps==0)
+    adaptstatsout(stats,"concentration",0,0);
 
-  // write initial data
-  vtkout(grid,c,"concentration",0,0);
+  // write initial data, later the grid is only copied for a snapshot
+  // if it was adapted since the previous one
+  VTKSnapshotWriter writer("concentration",format,async);
+  bool adapted = false;
+  writer.write(grid,c,0,0);
 
   // variables for time, timestep etc.
   double dt, t=0;
@@ -63,7 +81,8 @@ void timeloop (G& grid, double tend, int lmin, int lmax)
     if (t >= saveStep)
     {
       // write data
-      vtkout(grid,c,"concentration",counter,t);
+      writer.write(grid,c,counter,t,adapted);
+      adapted = false;
 
       // increase counter and saveStep for next interval
       saveStep += saveInterval;
@@ -75,13 +94,16 @@ void timeloop (G& grid, double tend, int lmin, int lmax)
               << " k=" << k << " t=" << t << " dt=" << dt << std::endl;
 
     // for unstructured grids call adaptation algorithm
-    finitevolumeadapt(grid,mapper,c,lmin,lmax,k);        /*@\label{afv:ad}@*/
+    finitevolumeadapt(grid,mapper,c,lmin,lmax,k,&stats); /*@\label{afv:ad}@*/
+    adapted = adapted || stats.adapted;
+    adaptstatsout(stats,"concentration",k,t);
   }
 
   // write last time step
-  vtkout(grid,c,"concentration",counter,tend);
+  writer.write(grid,c,counter,tend,adapted);
 
-  // write
+  // wait for the snapshots written in the background
+  writer.flush();
 }
 
 //===============================================================
@@ -97,6 +119,13 @@ int main (int argc , char ** argv)
   try {
     using namespace Dune;
 
+    // read the format of the VTK output, e.g. "-vtk zlib", and whether
+    // it is written in the background, "-async 1", from the command line
+    ParameterTree params;
+    ParameterTreeParser::readOptions(argc, argv, params);
+    const VTKOutputFormat format = vtkOutputFormat(params.get<std::string>("vtk", "binary"));
+    const bool async = params.get<bool>("async", false);
+
     // the GridSelector :: GridType is defined in gridtype.hh and is
     // set during compilation
     typedef GridSelector :: GridType Grid;
@@ -122,7 +151,7 @@ int main (int argc , char ** argv)
     int maxLevel = minLevel + 3 * DGFGridInfo<Grid>::refineStepsForHalf();
 
     // do time loop until end time 0.5
-    timeloop(grid, 0.5, minLevel, maxLevel);
+    timeloop(grid, 0.5, minLevel, maxLevel, format, async);
   }
   catch (std::exception & e) {
     std::cout << "ERROR: " << e.what() << std::endl;
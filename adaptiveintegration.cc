@@ -2,42 +2,79 @@
 // vi: set et ts=4 sw=2 sts=2:
 
 #include <config.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <string>
+#include <vector>
 #include <dune/grid/io/file/vtk/vtkwriter.hh> // VTK output routines
+#include <dune/grid/utility/persistentcontainer.hh>
 #include <dune/common/parallel/mpihelper.hh> // include mpi helper class
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
 
 #include "unitcube.hh"
 #include "functors.hh"
 #include "integrateentity.hh"
+#include "parallelintegration.hh"
+#include "bulkmarking.hh"
 
-
-//! adaptive refinement test
+//! adaptive refinement test, marking = "max" refines the elements with
+//! an error above a fraction of the maximal error, marking = "bulk" the
+//! smallest set of elements with theta times the total error
 template<class Grid, class Functor>
-void adaptiveintegration (Grid& grid, const Functor& f)
+void adaptiveintegration (Grid& grid, const Functor& f,
+                          const std::string& marking, double theta)
 {
   // get grid view type for leaf grid part
   typedef typename Grid::LeafGridView GridView;
   // get iterator type
   typedef typename GridView::template Codim<0>::Iterator ElementLeafIterator;
+  typedef typename Grid::template Codim<0>::Entity Element;
 
   // get grid view on leaf part
   GridView gridView = grid.leafGridView();
 
   // algorithm parameters
   const double tol=1E-8;
-  const int loworder=1;
-  const int highorder=3;
+
+  // scratch space for the quadrature points, reused for all elements
+  QuadratureBuffer<typename Grid::ctype,Grid::dimensionworld> buffer;
+
+  // The integrals of all elements, leaf elements and their fathers, are
+  // kept over the iterations. Elements are only refined, so the integrals
+  // only have to be computed for the elements created by adapt().
+  Dune::PersistentContainer<Grid,ElementIntegrals> cache(grid,0);
+  long integrations = 0;
+  auto integrals = [&] (const Element& element)
+  {
+    ElementIntegrals& entry = cache[element];
+    if (!entry.valid)
+    {
+      // integral of order 3, the error is estimated by the difference
+      // to order 1 computed from the same function values
+      const EmbeddedIntegral result = integrateEntityEmbedded(element,f,buffer);
+      entry.value = result.value;
+      entry.error = result.error;
+      entry.valid = true;
+      integrations += 1;
+    }
+    return entry;
+  };
 
   // loop over grid sequence
   double oldvalue=1E100;
-  for (int k=0; k<100; k++)
+  int iterations=0;
+  for (int k=0; k<100; k++, iterations++)
   {
-    // compute integral on current mesh
-    double value=0;                                      /*@\label{aic:int0}@*/
+    // compute integral on current mesh, the compensated summation
+    // avoids the rounding errors of adding many small contributions
+    CompensatedSum sum;                                  /*@\label{aic:int0}@*/
     for (ElementLeafIterator it = gridView.template begin<0>();
          it!=gridView.template end<0>(); ++it)
-      value += integrateEntity(*it,f,highorder);           /*@\label{aic:int1}@*/
+      sum.add(integrals(*it).value);                       /*@\label{aic:int1}@*/
+    double value=sum.value();
 
     // print result
     double estimated_error = std::abs(value-oldvalue);
@@ -49,6 +86,7 @@ void adaptiveintegration (Grid& grid, const Functor& f)
               << std::scientific << std::setprecision(8)
               << value
               << " error=" << estimated_error
+              << " integrations=" << integrations
               << std::endl;
 
     // check convergence
@@ -60,50 +98,75 @@ void adaptiveintegration (Grid& grid, const Functor& f)
     if (k==0)
     {
       grid.globalRefine(1);                            /*@\label{aic:gr}@*/
+      cache.resize();
+      cache.fill(ElementIntegrals());
       continue;
     }
 
-    // compute threshold for subsequent refinement
-    double maxerror=-1E100;                            /*@\label{aic:kappa0}@*/
-    double maxextrapolatederror=-1E100;
-    for (ElementLeafIterator it = grid.template leafbegin<0>();
-         it!=grid.template leafend<0>(); ++it)
+    // bulk criterion: mark the elements with an error of at least kappa
+    double kappa;
+    const bool bulk = (marking == "bulk");
+    if (bulk)
     {
-      // error on this entity
-      double lowresult=integrateEntity(*it,f,loworder);
-      double highresult=integrateEntity(*it,f,highorder);
-      double error = std::abs(lowresult-highresult);
-
-      // max over whole grid
-      maxerror = std::max(maxerror,error);
-
-      // error on father entity
-      double fatherlowresult=integrateEntity(it->father(),f,loworder);
-      double fatherhighresult=integrateEntity(it->father(),f,highorder);
-      double fathererror = std::abs(fatherlowresult-fatherhighresult);
-
-      // local extrapolation
-      double extrapolatederror = error*error/(fathererror+1E-30);
-      maxextrapolatederror = std::max(maxextrapolatederror,extrapolatederror);
+      std::vector<double> errors;
+      errors.reserve(gridView.size(0));
+      for (ElementLeafIterator it = gridView.template begin<0>();
+           it!=gridView.template end<0>(); ++it)
+        errors.push_back(integrals(*it).error);
+      kappa = bulkThreshold(errors, theta);
+    }
+    else
+    {
+      // compute threshold for subsequent refinement
+      double maxerror=-1E100;                            /*@\label{aic:kappa0}@*/
+      double maxextrapolatederror=-1E100;
+      for (ElementLeafIterator it = grid.template leafbegin<0>();
+           it!=grid.template leafend<0>(); ++it)
+      {
+        // error on this entity
+        double error = integrals(*it).error;
+
+        // max over whole grid
+        maxerror = std::max(maxerror,error);
+
+        // error on father entity
+        double fathererror = integrals(it->father()).error;
+
+        // local extrapolation
+        double extrapolatederror = error*error/(fathererror+1E-30);
+        maxextrapolatederror = std::max(maxextrapolatederror,extrapolatederror);
+      }
+      kappa = std::min(maxextrapolatederror,0.5*maxerror);       /*@\label{aic:kappa1}@*/
     }
-    double kappa = std::min(maxextrapolatederror,0.5*maxerror);       /*@\label{aic:kappa1}@*/
 
     // mark elements for refinement
     for (ElementLeafIterator it = gridView.template begin<0>();       /*@\label{aic:mark0}@*/
          it!=gridView.template end<0>(); ++it)
     {
-      double lowresult=integrateEntity(*it,f,loworder);
-      double highresult=integrateEntity(*it,f,highorder);
-      double error = std::abs(lowresult-highresult);
-      if (error>kappa) grid.mark(1,*it);
+      double error = integrals(*it).error;
+      if (error>kappa || (bulk && error==kappa && error>0))
+        grid.mark(1,*it);
     }                                                  /*@\label{aic:mark1}@*/
 
     // adapt the mesh
     grid.preAdapt();                                   /*@\label{aic:ref0}@*/
     grid.adapt();
+
+    // the new elements may reuse storage of the container, so their
+    // entries are reset while isNew() is still available
+    cache.resize();
+    for (ElementLeafIterator it = gridView.template begin<0>();
+         it!=gridView.template end<0>(); ++it)
+      if (it->isNew())
+        cache[*it] = ElementIntegrals();
     grid.postAdapt();                                  /*@\label{aic:ref1}@*/
   }
 
+  std::cout << "marking=" << marking
+            << " iterations=" << iterations
+            << " integrations=" << integrations
+            << std::endl;
+
   // write grid in VTK format
   Dune::VTKWriter<typename Grid::LeafGridView> vtkwriter(gridView);
   vtkwriter.write( "adaptivegrid", Dune::VTK::appendedraw );
@@ -111,9 +174,9 @@ void adaptiveintegration (Grid& grid, const Functor& f)
 
 //! supply functor
 template<class Grid>
-void dowork (Grid& grid)
+void dowork (Grid& grid, const std::string& marking, double theta)
 {
-  adaptiveintegration(grid,Needle<typename Grid::ctype,Grid::dimension>());
+  adaptiveintegration(grid,Needle<typename Grid::ctype,Grid::dimension>(),marking,theta);
 }
 
 int main(int argc, char **argv)
@@ -125,6 +188,14 @@ int main(int argc, char **argv)
   try {
     using namespace Dune;
 
+    // read options like "-marking bulk -theta 0.5" from the command line
+    ParameterTree params;
+    ParameterTreeParser::readOptions(argc, argv, params);
+    const std::string marking = params.get<std::string>("marking", "max");
+    const double theta = params.get<double>("theta", 0.5);
+    if (marking != "max" && marking != "bulk")
+      DUNE_THROW(Dune::Exception, "unknown marking strategy " << marking);
+
     // the GridSelector :: GridType is defined in gridtype.hh and is
     // set during compilation
     typedef GridSelector :: GridType Grid;
@@ -139,7 +210,7 @@ int main(int argc, char **argv)
 
     // do the adaptive integration
     // NOTE: for structured grids global refinement will be used
-    dowork( *gridPtr );
+    dowork( *gridPtr, marking, theta );
   }
   catch (std::exception & e) {
     std::cout << "ERROR: " << e.what() << std::endl;
@@ -0,0 +1,134 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_ADAPTSTATISTICS_HH__
+#define __DUNE_GRID_HOWTO_ADAPTSTATISTICS_HH__
+
+#include <cstddef>
+#include <fstream>
+#include <utility>
+#include <vector>
+#include <stdio.h>
+#include <sys/resource.h>
+
+// AdaptStatistics:
+// memory and time accounting for one call of finitevolumeadapt(). The
+// memory of the grid hierarchy itself is not measured, only its element
+// counts per level and the peak resident set size of the whole process
+// (ru_maxrss), which never decreases, e.g. when the grid is coarsened.
+struct AdaptStatistics
+{
+  bool adapted;                        // false if no element was marked
+  int marked;                          // number of marked elements
+  std::vector<int> elementsPerLevel;   // element counts after adaptation
+  int leafElements;                    // leaf element count after adaptation
+
+  std::size_t indicatorBytes;          // capacity of the indicator vector
+  std::size_t restrictionBytes;        // estimate for the restriction map
+  std::size_t dataBytes;               // capacity of the resized data vector
+  long peakRSS;                        // peak resident set size in kB
+
+  double markTime;                     // indicator computation and marking
+  double preAdaptTime;                 // grid.preAdapt()
+  double restrictTime;                 // filling the restriction map
+  double adaptTime;                    // grid.adapt()
+  double updateTime;                   // mapper.update() and resizing
+  double prolongTime;                  // interpolation to new elements
+  double postAdaptTime;                // grid.postAdapt()
+
+  AdaptStatistics ()
+  {
+    clear();
+  }
+
+  void clear ()
+  {
+    adapted = false;
+    marked = 0;
+    elementsPerLevel.clear();
+    leafElements = 0;
+    indicatorBytes = restrictionBytes = dataBytes = 0;
+    peakRSS = 0;
+    markTime = preAdaptTime = restrictTime = adaptTime = 0.0;
+    updateTime = prolongTime = postAdaptTime = 0.0;
+  }
+
+  // total time spent in the adaptation
+  double totalTime () const
+  {
+    return markTime + preAdaptTime + restrictTime + adaptTime
+           + updateTime + prolongTime + postAdaptTime;
+  }
+
+  // record the element counts of all levels and the leaf grid
+  template<class G>
+  void countElements (const G& grid)
+  {
+    elementsPerLevel.resize(grid.maxLevel()+1);
+    for (int level=0; level<=grid.maxLevel(); level++)
+      elementsPerLevel[level] = grid.size(level,0);
+    leafElements = grid.size(0);
+  }
+
+  // peak resident set size of this process in kB
+  static long currentPeakRSS ()
+  {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF,&usage) != 0)
+      return 0;
+    return usage.ru_maxrss;
+  }
+};
+
+//! estimate of the bytes held by a Dune::PersistentContainer of grid G
+//! with the given number of entries of type T. Its default implementation
+//! is a std::map from the ids to the values, which needs a tree node with
+//! three pointers and a color flag per entry besides the id and the value,
+//! and the allocator adds about two more words per node. The vectors used
+//! by some grids need less, so this errs on the safe side.
+template<class G, class T>
+std::size_t persistentContainerBytes (std::size_t entries)
+{
+  typedef typename G::LocalIdSet::IdType Id;
+  const std::size_t node = 4*sizeof(void*) + sizeof(std::pair<const Id,T>);
+  return entries * (node + 2*sizeof(void*));
+}
+
+// append the statistics of step k to the time series name.adaptstats,
+// which is written next to the name.series file of vtkout(). If newFile
+// is true the file is started again with a header line.
+inline void adaptstatsout (const AdaptStatistics& stats, const char* name,
+                           int k, double time, int rank, bool newFile)
+{
+  if (rank != 0)
+    return;
+
+  char statname[128];
+  sprintf(statname,"%s.adaptstats",name);
+  std::ofstream statstream(statname, (newFile ? std::ios_base::out : std::ios_base::app));
+  if (newFile)
+    statstream << "# k time adapted marked leafelements"
+               << " indicatorbytes restrictionbytes databytes peakrss[kB]"
+               << " mark preadapt restrict adapt update prolong postadapt total[s]"
+               << " elementsperlevel" << std::endl;
+
+  statstream << k << " " << time << " " << stats.adapted << " " << stats.marked
+             << " " << stats.leafElements
+             << " " << stats.indicatorBytes << " " << stats.restrictionBytes
+             << " " << stats.dataBytes << " " << stats.peakRSS
+             << " " << stats.markTime << " " << stats.preAdaptTime
+             << " " << stats.restrictTime << " " << stats.adaptTime
+             << " " << stats.updateTime << " " << stats.prolongTime
+             << " " << stats.postAdaptTime << " " << stats.totalTime() << " ";
+  for (std::size_t level=0; level<stats.elementsPerLevel.size(); level++)
+    statstream << (level>0 ? ":" : "") << stats.elementsPerLevel[level];
+  statstream << std::endl;
+}
+
+// as above, the file is started again for k=0
+inline void adaptstatsout (const AdaptStatistics& stats, const char* name,
+                           int k, double time=0.0, int rank=0)
+{
+  adaptstatsout(stats,name,k,time,rank,k==0);
+}
+
+#endif // __DUNE_GRID_HOWTO_ADAPTSTATISTICS_HH__
@@ -0,0 +1,104 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_AFFINEGEOMETRY_HH__
+#define __DUNE_GRID_HOWTO_AFFINEGEOMETRY_HH__
+
+#include <cstddef>
+
+#include <dune/common/fmatrix.hh>
+#include <dune/common/fvector.hh>
+
+// AffineGeometryCache:
+// the map x = x0 + J xi of an affine element geometry. bind() asks the
+// geometry once whether it is affine and then stores the offset x0, the
+// Jacobian J, its inverse transposed and the integration element, which
+// are the same at all points. Quadrature points are then mapped by one
+// small matrix-vector product each instead of calls of global() and
+// integrationElement() on the geometry.
+template<class ctype, int mydim, int cdim>
+class AffineGeometryCache
+{
+public:
+  typedef Dune::FieldVector<ctype,mydim> LocalCoordinate;
+  typedef Dune::FieldVector<ctype,cdim> GlobalCoordinate;
+  typedef Dune::FieldMatrix<ctype,cdim,mydim> Jacobian;
+
+  AffineGeometryCache () : affine_(false), integrationElement_(0.0) {}
+
+  // returns false and leaves the cache unusable if geo is not affine
+  template<class Geometry>
+  bool bind (const Geometry& geo)
+  {
+    affine_ = geo.affine();
+    if (!affine_)
+      return false;
+
+    const LocalCoordinate origin(0.0);
+    offset_ = geo.global(origin);
+    integrationElement_ = geo.integrationElement(origin);
+
+    // the geometries may return special matrix types, so the matrices
+    // are filled column by column through matrix-vector products
+    const auto jacobianT = geo.jacobianTransposed(origin);
+    const auto jacInvTra = geo.jacobianInverseTransposed(origin);
+    for (int j = 0; j < mydim; j++)
+    {
+      LocalCoordinate e(0.0);
+      e[j] = 1.0;
+      GlobalCoordinate column(0.0);
+      jacobianT.umtv(e, column);
+      GlobalCoordinate inverseColumn;
+      jacInvTra.mv(e, inverseColumn);
+      for (int i = 0; i < cdim; i++)
+      {
+        jacobian_[i][j] = column[i];
+        jacobianInverseTransposed_[i][j] = inverseColumn[i];
+      }
+    }
+    return true;
+  }
+
+  bool affine () const
+  {
+    return affine_;
+  }
+
+  GlobalCoordinate global (const LocalCoordinate& local) const
+  {
+    GlobalCoordinate x(offset_);
+    jacobian_.umv(local, x);
+    return x;
+  }
+
+  // map n points at once
+  template<class Rule>
+  void global (const Rule& rule, GlobalCoordinate* x) const
+  {
+    for (std::size_t q = 0; q < rule.size(); q++)
+      x[q] = global(rule[q].position());
+  }
+
+  ctype integrationElement () const
+  {
+    return integrationElement_;
+  }
+
+  const Jacobian& jacobian () const
+  {
+    return jacobian_;
+  }
+
+  const Jacobian& jacobianInverseTransposed () const
+  {
+    return jacobianInverseTransposed_;
+  }
+
+private:
+  bool affine_;
+  GlobalCoordinate offset_;
+  Jacobian jacobian_;
+  Jacobian jacobianInverseTransposed_;
+  ctype integrationElement_;
+};
+
+#endif // __DUNE_GRID_HOWTO_AFFINEGEOMETRY_HH__
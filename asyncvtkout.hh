@@ -0,0 +1,254 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_ASYNCVTKOUT_HH__
+#define __DUNE_GRID_HOWTO_ASYNCVTKOUT_HH__
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <dune/common/exceptions.hh>
+#include <dune/common/timer.hh>
+#include <stdio.h>
+
+#include "compressedvtkwriter.hh"
+#include "vtkout.hh"
+
+// VTKSnapshotWriter:
+// writes the snapshots of a time loop like vtkout(), either at once or,
+// if async is true, in a background thread so that the time loop goes on
+// while a file is written. write() then copies the cell data, and the
+// grid only if it changed since the last snapshot, into buffers which do
+// not depend on the grid any more and appends them to a queue. If
+// maxPending snapshots are waiting already, write() waits for the
+// thread. The cell data buffers of written snapshots are reused, so with
+// the default of one waiting snapshot one buffer is filled while the
+// other one is written. flush() waits until all snapshots are written.
+class VTKSnapshotWriter
+{
+public:
+  VTKSnapshotWriter (const std::string& name, VTKOutputFormat format, bool async,
+                     int rank=0, std::size_t maxPending=1)
+    : name_(name), format_(format), async_(async), rank_(rank),
+      maxPending_(std::max<std::size_t>(maxPending,1)), busy_(false), stop_(false),
+      bytes_(0), seconds_(0.0)
+  {
+    if (async_ && format_ == VTKOutputFormat::ascii)
+      DUNE_THROW(Dune::NotImplemented, "asynchronous VTK output in ascii format");
+    if (async_)
+      thread_ = std::thread([this] { run(); });
+  }
+
+  ~VTKSnapshotWriter ()
+  {
+    if (!async_)
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+
+  VTKSnapshotWriter (const VTKSnapshotWriter&) = delete;
+  VTKSnapshotWriter& operator= (const VTKSnapshotWriter&) = delete;
+
+  // write snapshot k at the given time, meshChanged may be false if the
+  // grid is the same as in the previous call
+  template<class G, class V>
+  void write (const G& grid, const V& c, int k, double time, bool meshChanged=true)
+  {
+    if (!async_)
+    {
+      const VTKOutputStatistics stats = vtkout(grid,c,name_.c_str(),k,time,rank_,format_);
+      bytes_ += stats.bytes;
+      seconds_ += stats.seconds;
+      return;
+    }
+
+    // take a free buffer once there is room in the queue
+    Snapshot snapshot;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this] { return queue_.size() < maxPending_ || error_; });
+      rethrow();
+      if (!free_.empty())
+      {
+        snapshot.cellData.swap(free_.back());
+        free_.pop_back();
+      }
+    }
+
+    // the copies are made while the grid does not change
+    if (meshChanged || !geometry_)
+    {
+      std::shared_ptr<VTUGeometry> geometry = std::make_shared<VTUGeometry>();
+      extractVTUGeometry(grid.leafGridView(), *geometry);
+      geometry_ = geometry;
+    }
+    extractVTUCellData(grid.leafGridView(), c, snapshot.cellData);
+    snapshot.geometry = geometry_;
+    snapshot.k = k;
+    snapshot.time = time;
+    snapshot.rank = grid.comm().rank();
+    snapshot.size = grid.comm().size();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(snapshot));
+    }
+    changed_.notify_all();
+  }
+
+  // wait until all snapshots are written and return the bytes and the
+  // time of all snapshots written by this process so far
+  VTKOutputStatistics flush ()
+  {
+    if (async_)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this] { return (queue_.empty() && !busy_) || error_; });
+      rethrow();
+    }
+    VTKOutputStatistics stats;
+    stats.bytes = bytes_;
+    stats.seconds = seconds_;
+    return stats;
+  }
+
+private:
+  // the copy of the data of one snapshot
+  struct Snapshot
+  {
+    int k;
+    double time;
+    int rank;
+    int size;
+    std::shared_ptr<const VTUGeometry> geometry;
+    std::vector<float> cellData;
+  };
+
+  // throw the error of the thread in the calling thread, mutex_ is locked
+  void rethrow ()
+  {
+    if (error_)
+    {
+      std::exception_ptr error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+  // the background thread, writes the snapshots in the order of the queue
+  // until stop_ is set and the queue is empty
+  void run ()
+  {
+    for (;;)
+    {
+      Snapshot snapshot;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+          return;
+        snapshot = std::move(queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+      }
+      changed_.notify_all();
+
+      std::exception_ptr error;
+      try {
+        writeSnapshot(snapshot);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error)
+          error_ = error;
+        free_.push_back(std::move(snapshot.cellData));
+        busy_ = false;
+      }
+      changed_.notify_all();
+    }
+  }
+
+  // write the files and the series entry as vtkout() does, the bytes are
+  // those of this process only
+  void writeSnapshot (const Snapshot& snapshot)
+  {
+    Dune::Timer timer;
+    char fname[128];
+    char sername[128];
+    sprintf(fname,"%s-%05d",name_.c_str(),snapshot.k);
+    sprintf(sername,"%s.series",name_.c_str());
+    writeVTU(*snapshot.geometry, snapshot.cellData, "celldata", fname,
+             snapshot.rank, snapshot.size, format_ == VTKOutputFormat::zlib);
+
+    long bytes;
+    if (snapshot.size == 1)
+      bytes = fileBytes(std::string(fname) + ".vtu");
+    else
+    {
+      bytes = fileBytes(vtkPieceName(fname, snapshot.rank, snapshot.size));
+      if (snapshot.rank == 0)
+        bytes += fileBytes(vtkParallelHeaderName(fname, snapshot.size));
+    }
+    const double seconds = timer.elapsed();
+    bytes_ += bytes;
+    seconds_ += seconds;
+
+    if (rank_ == 0)
+    {
+      std::ofstream serstream(sername, (snapshot.k==0 ? std::ios_base::out : std::ios_base::app));
+      serstream << snapshot.k << " " << fname << ".vtu " << snapshot.time << std::endl;
+      serstream.close();
+
+      // one string, so the line is not mixed with the output of the time loop
+      std::ostringstream line;
+      line << "vtkout " << fname << " bytes=" << bytes
+           << " seconds=" << seconds << " (background)\n";
+      std::cout << line.str() << std::flush;
+    }
+  }
+
+  std::string name_;
+  VTKOutputFormat format_;
+  bool async_;
+  int rank_;
+  std::size_t maxPending_;
+
+  // the grid of the last snapshot, shared by the snapshots until it changes
+  std::shared_ptr<const VTUGeometry> geometry_;
+
+  // state shared with the thread, guarded by mutex_
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<Snapshot> queue_;
+  std::vector<std::vector<float> > free_;
+  bool busy_;
+  bool stop_;
+  std::exception_ptr error_;
+
+  // written by the thread, read by flush() after it is idle
+  long bytes_;
+  double seconds_;
+
+  std::thread thread_;
+};
+
+#endif // __DUNE_GRID_HOWTO_ASYNCVTKOUT_HH__
@@ -0,0 +1,50 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_BULKMARKING_HH__
+#define __DUNE_GRID_HOWTO_BULKMARKING_HH__
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <vector>
+
+//! threshold of the bulk criterion of Doerfler: the elements with an
+//! error of at least the threshold form the smallest set whose errors
+//! sum up to fraction times the total error. Instead of sorting, the
+//! range containing the threshold is halved by std::nth_element, which
+//! takes linear time on average.
+inline double bulkThreshold (std::vector<double> errors, double fraction)
+{
+  if (errors.empty())
+    return std::numeric_limits<double>::infinity();
+
+  double total = 0.0;
+  for (double error : errors)
+    total += error;
+  const double target = fraction*total;
+
+  // the elements before begin are the largest ones, their sum is still
+  // below the target, which is reached within [begin,end)
+  std::size_t begin = 0, end = errors.size();
+  double accumulated = 0.0;
+  while (end - begin > 1)
+  {
+    const std::size_t middle = begin + (end - begin)/2;
+    std::nth_element(errors.begin()+begin, errors.begin()+middle, errors.begin()+end,
+                     std::greater<double>());
+    double upper = 0.0;
+    for (std::size_t i = begin; i < middle; i++)
+      upper += errors[i];
+    if (accumulated + upper >= target)
+      end = middle;
+    else
+    {
+      accumulated += upper;
+      begin = middle;
+    }
+  }
+  return errors[begin];
+}
+
+#endif // __DUNE_GRID_HOWTO_BULKMARKING_HH__
@@ -0,0 +1,284 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_COMPRESSEDVTKWRITER_HH__
+#define __DUNE_GRID_HOWTO_COMPRESSEDVTKWRITER_HH__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/grid/common/mcmgmapper.hh>
+#include <dune/grid/common/partitionset.hh>
+#include <dune/grid/io/file/vtk/common.hh>
+
+#if DUNE_GRID_HOWTO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// AppendedVTKArrays:
+// the data arrays of a VTK XML file in the appended binary format. Each
+// array is preceded by its size in bytes as a 64 bit integer or, with
+// compression, split into blocks of 32 kB which are compressed by zlib
+// separately as done by vtkZLibDataCompressor. The header of a
+// compressed array holds the number of blocks, the block sizes and the
+// compressed sizes, all as 64 bit integers.
+class AppendedVTKArrays
+{
+public:
+  AppendedVTKArrays (bool compress) : compress_(compress)
+  {
+#if !DUNE_GRID_HOWTO_HAVE_ZLIB
+    if (compress_)
+      DUNE_THROW(Dune::NotImplemented, "compressed VTK output needs zlib");
+#endif
+  }
+
+  // append n values of x and return the offset of the array in the
+  // appended data
+  template<class T>
+  std::uint64_t add (const T* x, std::size_t n)
+  {
+    const std::uint64_t offset = data_.size();
+    const std::uint64_t bytes = n*sizeof(T);
+    if (!compress_)
+    {
+      append(&bytes, sizeof(bytes));
+      append(x, bytes);
+      return offset;
+    }
+#if DUNE_GRID_HOWTO_HAVE_ZLIB
+    const std::size_t blockSize = 32768;
+    const std::size_t blocks = (bytes + blockSize - 1) / blockSize;
+    const unsigned char* source = reinterpret_cast<const unsigned char*>(x);
+
+    std::vector<std::uint64_t> header(3 + blocks);
+    header[0] = blocks;
+    header[1] = blockSize;
+    header[2] = (bytes % blockSize == 0 && bytes > 0) ? blockSize : bytes % blockSize;
+
+    std::vector<unsigned char> compressed;
+    for (std::size_t b = 0; b < blocks; b++)
+    {
+      const std::size_t size = std::min<std::size_t>(blockSize, bytes - b*blockSize);
+      uLongf compressedSize = compressBound(size);
+      const std::size_t begin = compressed.size();
+      compressed.resize(begin + compressedSize);
+      if (compress2(compressed.data() + begin, &compressedSize,
+                    source + b*blockSize, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+        DUNE_THROW(Dune::IOError, "zlib compression failed");
+      compressed.resize(begin + compressedSize);
+      header[3+b] = compressedSize;
+    }
+
+    append(header.data(), header.size()*sizeof(std::uint64_t));
+    append(compressed.data(), compressed.size());
+#endif
+    return offset;
+  }
+
+  const std::vector<char>& data () const
+  {
+    return data_;
+  }
+
+private:
+  void append (const void* x, std::size_t bytes)
+  {
+    const char* begin = static_cast<const char*>(x);
+    data_.insert(data_.end(), begin, begin + bytes);
+  }
+
+  bool compress_;
+  std::vector<char> data_;
+};
+
+//! byte order of this machine as written to VTK files
+inline const char* vtkByteOrder ()
+{
+  const std::uint16_t one = 1;
+  char first;
+  std::memcpy(&first, &one, 1);
+  return first ? "LittleEndian" : "BigEndian";
+}
+
+//! name of the file of process rank in a parallel VTK output, the same as
+//! used by Dune::VTKWriter
+inline std::string vtkPieceName (const std::string& name, int rank, int size,
+                                 const char* extension = ".vtu")
+{
+  std::ostringstream s;
+  s << 's' << std::setw(4) << std::setfill('0') << size << '-'
+    << 'p' << std::setw(4) << std::setfill('0') << rank << '-'
+    << name << extension;
+  return s.str();
+}
+
+//! name of the file written by process 0 in a parallel VTK output which
+//! references the files of all processes, the same as used by
+//! Dune::VTKWriter
+inline std::string vtkParallelHeaderName (const std::string& name, int size,
+                                          const char* extension = ".pvtu")
+{
+  std::ostringstream s;
+  s << 's' << std::setw(4) << std::setfill('0') << size << '-'
+    << name << extension;
+  return s.str();
+}
+
+// VTUGeometry:
+// the vertices and the interior elements of a grid view in the arrays of
+// a VTK unstructured grid, the corners in the VTK numbering
+struct VTUGeometry
+{
+  std::vector<float> points;
+  std::vector<std::int32_t> connectivity;
+  std::vector<std::int32_t> offsets;
+  std::vector<std::uint8_t> types;
+};
+
+//! fill geometry from the grid view
+template<class GridView>
+void extractVTUGeometry (const GridView& gridView, VTUGeometry& geometry)
+{
+  const int dim = GridView::dimension;
+  const auto& indexSet = gridView.indexSet();
+
+  // the coordinates of all vertices, unused ones are allowed by VTK
+  geometry.points.assign(3*indexSet.size(dim), 0.0f);
+  for (const auto& vertex : vertices(gridView))
+  {
+    const auto x = vertex.geometry().corner(0);
+    for (int i = 0; i < GridView::dimensionworld && i < 3; i++)
+      geometry.points[3*indexSet.index(vertex)+i] = x[i];
+  }
+
+  geometry.connectivity.clear();
+  geometry.offsets.clear();
+  geometry.types.clear();
+  for (const auto& element : elements(gridView, Dune::Partitions::interior))
+  {
+    const Dune::GeometryType gt = element.type();
+    const int corners = element.subEntities(dim);
+    for (int i = 0; i < corners; i++)
+      geometry.connectivity.push_back(indexSet.subIndex(element, Dune::VTK::renumber(gt,i), dim));
+    geometry.offsets.push_back(geometry.connectivity.size());
+    geometry.types.push_back(Dune::VTK::geometryType(gt));
+  }
+}
+
+//! copy the cell data c, indexed by the element mapper, in the order of
+//! the elements of extractVTUGeometry()
+template<class GridView, class V>
+void extractVTUCellData (const GridView& gridView, const V& c, std::vector<float>& cellData)
+{
+  Dune::MultipleCodimMultipleGeomTypeMapper<GridView>
+  mapper(gridView, Dune::mcmgElementLayout());
+  cellData.clear();
+  for (const auto& element : elements(gridView, Dune::Partitions::interior))
+    cellData.push_back(c[mapper.index(element)]);
+}
+
+//! write geometry and cell data in the VTK XML format with appended
+//! binary data, compressed by zlib if requested. If size > 1 this is the
+//! file of process rank and process 0 also writes the header file
+//! referencing the files of all processes, both named like the files of
+//! Dune::VTKWriter. The grid is not used, so this
+//! can run in a thread other than the one modifying the grid.
+inline void writeVTU (const VTUGeometry& geometry, const std::vector<float>& cellData,
+                      const std::string& dataName, const std::string& name,
+                      int rank, int size, bool compress)
+{
+  AppendedVTKArrays arrays(compress);
+  const std::uint64_t cellDataOffset = arrays.add(cellData.data(), cellData.size());
+  const std::uint64_t pointsOffset = arrays.add(geometry.points.data(), geometry.points.size());
+  const std::uint64_t connectivityOffset
+    = arrays.add(geometry.connectivity.data(), geometry.connectivity.size());
+  const std::uint64_t offsetsOffset = arrays.add(geometry.offsets.data(), geometry.offsets.size());
+  const std::uint64_t typesOffset = arrays.add(geometry.types.data(), geometry.types.size());
+
+  std::ostringstream fileType;
+  fileType << "version=\"1.0\" byte_order=\"" << vtkByteOrder() << "\" header_type=\"UInt64\"";
+  if (compress)
+    fileType << " compressor=\"vtkZLibDataCompressor\"";
+
+  const std::string fileName = (size > 1) ? vtkPieceName(name, rank, size) : name + ".vtu";
+  std::ofstream file(fileName, std::ios_base::binary);
+  if (!file)
+    DUNE_THROW(Dune::IOError, "could not open " << fileName);
+
+  file << "<?xml version=\"1.0\"?>\n"
+       << "<VTKFile type=\"UnstructuredGrid\" " << fileType.str() << ">\n"
+       << " <UnstructuredGrid>\n"
+       << "  <Piece NumberOfPoints=\"" << geometry.points.size()/3
+       << "\" NumberOfCells=\"" << geometry.types.size() << "\">\n"
+       << "   <CellData Scalars=\"" << dataName << "\">\n"
+       << "    <DataArray type=\"Float32\" Name=\"" << dataName
+       << "\" NumberOfComponents=\"1\" format=\"appended\" offset=\""
+       << cellDataOffset << "\"/>\n"
+       << "   </CellData>\n"
+       << "   <Points>\n"
+       << "    <DataArray type=\"Float32\" Name=\"Coordinates\""
+       << " NumberOfComponents=\"3\" format=\"appended\" offset=\""
+       << pointsOffset << "\"/>\n"
+       << "   </Points>\n"
+       << "   <Cells>\n"
+       << "    <DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\""
+       << connectivityOffset << "\"/>\n"
+       << "    <DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\" offset=\""
+       << offsetsOffset << "\"/>\n"
+       << "    <DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\""
+       << typesOffset << "\"/>\n"
+       << "   </Cells>\n"
+       << "  </Piece>\n"
+       << " </UnstructuredGrid>\n"
+       << " <AppendedData encoding=\"raw\">\n"
+       << "_";
+  file.write(arrays.data().data(), arrays.data().size());
+  file << "\n </AppendedData>\n"
+       << "</VTKFile>\n";
+
+  if (size == 1 || rank != 0)
+    return;
+
+  const std::string headerName = vtkParallelHeaderName(name, size);
+  std::ofstream header(headerName);
+  if (!header)
+    DUNE_THROW(Dune::IOError, "could not open " << headerName);
+  header << "<?xml version=\"1.0\"?>\n"
+         << "<VTKFile type=\"PUnstructuredGrid\" " << fileType.str() << ">\n"
+         << " <PUnstructuredGrid GhostLevel=\"0\">\n"
+         << "  <PCellData Scalars=\"" << dataName << "\">\n"
+         << "   <PDataArray type=\"Float32\" Name=\"" << dataName
+         << "\" NumberOfComponents=\"1\"/>\n"
+         << "  </PCellData>\n"
+         << "  <PPoints>\n"
+         << "   <PDataArray type=\"Float32\" Name=\"Coordinates\" NumberOfComponents=\"3\"/>\n"
+         << "  </PPoints>\n";
+  for (int p = 0; p < size; p++)
+    header << "  <Piece Source=\"" << vtkPieceName(name, p, size) << "\"/>\n";
+  header << " </PUnstructuredGrid>\n"
+         << "</VTKFile>\n";
+}
+
+//! write the leaf grid view and the cell data c, indexed by the element
+//! mapper, with appended zlib compressed binary data, which
+//! Dune::VTKWriter does not provide
+template<class GridView, class V>
+void writeCompressedVTU (const GridView& gridView, const V& c,
+                         const std::string& dataName, const std::string& name)
+{
+  VTUGeometry geometry;
+  extractVTUGeometry(gridView, geometry);
+  std::vector<float> cellData;
+  extractVTUCellData(gridView, c, cellData);
+  writeVTU(geometry, cellData, dataName, name,
+           gridView.comm().rank(), gridView.comm().size(), true);
+}
+
+#endif // __DUNE_GRID_HOWTO_COMPRESSEDVTKWRITER_HH__
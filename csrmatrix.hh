@@ -0,0 +1,292 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_CSRMATRIX_HH__
+#define __DUNE_GRID_HOWTO_CSRMATRIX_HH__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+
+#include "csrpattern.hh"
+
+// CSRMatrix:
+// a minimal sparse matrix in compressed row storage for builds without
+// dune-istl. The sparsity is given by a CSRPattern, which has to live as
+// long as the matrix, only the values are stored here. The row access
+// mimics the BCRSMatrix interface used by the P1 assembly.
+template<class K>
+class CSRMatrix
+{
+public:
+  typedef K field_type;
+  typedef std::size_t size_type;
+
+  // access to one row, entries are found by binary search
+  class RowProxy
+  {
+  public:
+    // iterator over the entries of a row
+    class Iterator
+    {
+    public:
+      Iterator (K* value, const int* column)
+        : value_(value), column_(column)
+      {}
+
+      K& operator* () const
+      {
+        return *value_;
+      }
+
+      size_type index () const
+      {
+        return *column_;
+      }
+
+      Iterator& operator++ ()
+      {
+        ++value_;
+        ++column_;
+        return *this;
+      }
+
+      bool operator!= (const Iterator& other) const
+      {
+        return column_ != other.column_;
+      }
+
+      bool operator== (const Iterator& other) const
+      {
+        return column_ == other.column_;
+      }
+
+    private:
+      K* value_;
+      const int* column_;
+    };
+
+    RowProxy (CSRMatrix* matrix, size_type row)
+      : matrix_(matrix), row_(row)
+    {}
+
+    size_type index () const
+    {
+      return row_;
+    }
+
+    K& operator[] (size_type j) const
+    {
+      const CSRPattern& pattern = *matrix_->pattern_;
+      const int* pos = std::lower_bound(pattern.begin(row_),pattern.end(row_),int(j));
+      if (pos == pattern.end(row_) || *pos != int(j))
+        DUNE_THROW(Dune::RangeError, "entry (" << row_ << "," << j << ") not in pattern");
+      return matrix_->values_[pos - pattern.columns().data()];
+    }
+
+    // set all entries of the row to k
+    RowProxy& operator= (const K& k)
+    {
+      for (Iterator it = begin(); it != end(); ++it)
+        *it = k;
+      return *this;
+    }
+
+    Iterator begin () const
+    {
+      const CSRPattern& pattern = *matrix_->pattern_;
+      return Iterator(matrix_->values_.data()+pattern.offset(row_), pattern.begin(row_));
+    }
+
+    Iterator end () const
+    {
+      const CSRPattern& pattern = *matrix_->pattern_;
+      return Iterator(matrix_->values_.data()+pattern.offset(row_+1), pattern.end(row_));
+    }
+
+  private:
+    CSRMatrix* matrix_;
+    size_type row_;
+  };
+
+  // iterator over the rows
+  class RowIterator
+  {
+  public:
+    RowIterator (CSRMatrix* matrix, size_type row)
+      : matrix_(matrix), proxy_(matrix,row)
+    {}
+
+    RowProxy& operator* ()
+    {
+      return proxy_;
+    }
+
+    RowProxy* operator-> ()
+    {
+      return &proxy_;
+    }
+
+    size_type index () const
+    {
+      return proxy_.index();
+    }
+
+    RowIterator& operator++ ()
+    {
+      proxy_ = RowProxy(matrix_,proxy_.index()+1);
+      return *this;
+    }
+
+    bool operator!= (const RowIterator& other) const
+    {
+      return index() != other.index();
+    }
+
+    bool operator== (const RowIterator& other) const
+    {
+      return index() == other.index();
+    }
+
+  private:
+    CSRMatrix* matrix_;
+    RowProxy proxy_;
+  };
+
+  CSRMatrix ()
+    : pattern_(nullptr)
+  {}
+
+  // use the given sparsity pattern, all values are set to zero
+  void setPattern (const CSRPattern& pattern)
+  {
+    pattern_ = &pattern;
+    values_.assign(pattern.nonzeroes(), 0.0);
+  }
+
+  size_type N () const
+  {
+    return pattern_ ? pattern_->rows() : 0;
+  }
+
+  size_type nonzeroes () const
+  {
+    return values_.size();
+  }
+
+  CSRMatrix& operator= (const K& k)
+  {
+    std::fill(values_.begin(), values_.end(), k);
+    return *this;
+  }
+
+  RowProxy operator[] (size_type i)
+  {
+    return RowProxy(this,i);
+  }
+
+  RowIterator begin ()
+  {
+    return RowIterator(this,0);
+  }
+
+  RowIterator end ()
+  {
+    return RowIterator(this,N());
+  }
+
+  // y = A x
+  template<class X, class Y>
+  void mv (const X& x, Y& y) const
+  {
+    const std::vector<int>& columns = pattern_->columns();
+    for (size_type i = 0; i < N(); i++)
+    {
+      K sum = 0.0;
+      for (size_type k = pattern_->offset(i); k < pattern_->offset(i+1); k++)
+        sum += values_[k]*x[columns[k]];
+      y[i] = sum;
+    }
+  }
+
+  // diagonal entry of row i
+  K diagonal (size_type i) const
+  {
+    const int* pos = std::lower_bound(pattern_->begin(i),pattern_->end(i),int(i));
+    if (pos == pattern_->end(i) || *pos != int(i))
+      return 0.0;
+    return values_[pos - pattern_->columns().data()];
+  }
+
+  // bytes held by the values, the pattern is not included
+  std::size_t memory () const
+  {
+    return values_.capacity()*sizeof(K);
+  }
+
+private:
+  const CSRPattern* pattern_;
+  std::vector<K> values_;
+};
+
+//! Jacobi preconditioned conjugate gradients for a symmetric positive
+//! definite CSRMatrix, iterates until the residual norm is reduced by the
+//! given factor and returns the number of iterations
+template<class K, class V>
+int csrSolveCG (const CSRMatrix<K>& A, V& x, const V& b,
+                K reduction, int maxIterations, K& achievedReduction)
+{
+  const std::size_t n = A.N();
+  std::vector<K> r(n), z(n), p(n), q(n), invdiag(n);
+  for (std::size_t i = 0; i < n; i++)
+    invdiag[i] = 1.0/A.diagonal(i);
+
+  auto dot = [n] (const std::vector<K>& v, const std::vector<K>& w)
+  {
+    K sum = 0.0;
+    for (std::size_t i = 0; i < n; i++)
+      sum += v[i]*w[i];
+    return sum;
+  };
+
+  // r = b - A x
+  A.mv(x, q);
+  for (std::size_t i = 0; i < n; i++)
+    r[i] = b[i] - q[i];
+  const K norm0 = std::sqrt(dot(r,r));
+  achievedReduction = 1.0;
+  if (norm0 == 0.0)
+    return 0;
+
+  for (std::size_t i = 0; i < n; i++)
+    p[i] = z[i] = invdiag[i]*r[i];
+  K rho = dot(r,z);
+
+  for (int k = 1; k <= maxIterations; k++)
+  {
+    A.mv(p, q);
+    const K alpha = rho/dot(p,q);
+    for (std::size_t i = 0; i < n; i++)
+    {
+      x[i] += alpha*p[i];
+      r[i] -= alpha*q[i];
+    }
+
+    achievedReduction = std::sqrt(dot(r,r))/norm0;
+    if (achievedReduction <= reduction)
+      return k;
+
+    for (std::size_t i = 0; i < n; i++)
+      z[i] = invdiag[i]*r[i];
+    const K rhoNew = dot(r,z);
+    const K beta = rhoNew/rho;
+    rho = rhoNew;
+    for (std::size_t i = 0; i < n; i++)
+      p[i] = z[i] + beta*p[i];
+  }
+  return maxIterations;
+}
+
+#endif // __DUNE_GRID_HOWTO_CSRMATRIX_HH__
@@ -0,0 +1,201 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_CSRPATTERN_HH__
+#define __DUNE_GRID_HOWTO_CSRPATTERN_HH__
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// CSRPattern:
+// sparsity pattern in compressed row storage, the sorted column indices
+// of row i are stored in columns()[offset(i)] ... columns()[offset(i+1)-1]
+class CSRPattern
+{
+public:
+  typedef std::size_t size_type;
+
+  size_type rows () const
+  {
+    return offsets_.empty() ? 0 : offsets_.size()-1;
+  }
+
+  size_type nonzeroes () const
+  {
+    return columns_.size();
+  }
+
+  size_type offset (size_type i) const
+  {
+    return offsets_[i];
+  }
+
+  size_type rowSize (size_type i) const
+  {
+    return offsets_[i+1]-offsets_[i];
+  }
+
+  const int* begin (size_type i) const
+  {
+    return columns_.data()+offsets_[i];
+  }
+
+  const int* end (size_type i) const
+  {
+    return columns_.data()+offsets_[i+1];
+  }
+
+  const std::vector<int>& columns () const
+  {
+    return columns_;
+  }
+
+  // largest distance of an entry from the diagonal
+  size_type bandwidth () const
+  {
+    size_type width = 0;
+    for (size_type i=0; i<rows(); i++)
+      if (rowSize(i) > 0)
+      {
+        const size_type lower = i - std::min<size_type>(i,*begin(i));
+        const size_type upper = std::max<size_type>(i,*(end(i)-1)) - i;
+        width = std::max(width,std::max(lower,upper));
+      }
+    return width;
+  }
+
+  // build a pattern with n rows from a traversal of all couplings:
+  // traverse(add) has to call add(rows,nrows,cols,ncols) to couple each
+  // of the nrows indices in rows with each of the ncols indices in cols.
+  // The traversal is run twice, first to count the entries per row and
+  // then to fill them in, duplicates are removed afterwards.
+  template<class Traversal>
+  void build (size_type n, Traversal traverse)
+  {
+    // count pass, gives an upper bound for the size of each row
+    offsets_.assign(n+1,0);
+    traverse([this] (const int* r, int nr, const int* c, int nc)
+    {
+      for (int i=0; i<nr; i++)
+        offsets_[r[i]+1] += nc;
+    });
+    for (size_type i=0; i<n; i++)
+      offsets_[i+1] += offsets_[i];
+
+    // fill pass
+    columns_.resize(offsets_[n]);
+    std::vector<size_type> next(offsets_.begin(),offsets_.end()-1);
+    traverse([this,&next] (const int* r, int nr, const int* c, int nc)
+    {
+      for (int i=0; i<nr; i++)
+        for (int j=0; j<nc; j++)
+          columns_[next[r[i]]++] = c[j];
+    });
+
+    // sort each row, remove duplicates and compact in place
+    size_type pos = 0;
+    for (size_type i=0; i<n; i++)
+    {
+      int* rowbegin = columns_.data()+offsets_[i];
+      int* rowend = columns_.data()+offsets_[i+1];
+      std::sort(rowbegin,rowend);
+      rowend = std::unique(rowbegin,rowend);
+      offsets_[i] = pos;
+      pos = std::copy(rowbegin,rowend,columns_.data()+pos)-columns_.data();
+    }
+    offsets_[n] = pos;
+    columns_.resize(pos);
+    columns_.shrink_to_fit();
+  }
+
+  // set up the sparsity of a BCRSMatrix with m columns in random build
+  // mode, passing whole rows instead of single indices
+  template<class Matrix>
+  void setupMatrix (Matrix& A, size_type m) const
+  {
+    A.setSize(rows(),m,nonzeroes());
+    A.setBuildMode(Matrix::random);
+    for (size_type i=0; i<rows(); i++)
+      A.setrowsize(i,rowSize(i));
+    A.endrowsizes();
+    for (size_type i=0; i<rows(); i++)
+      A.setIndices(i,begin(i),end(i));
+    A.endindices();
+  }
+
+private:
+  std::vector<size_type> offsets_;
+  std::vector<int> columns_;
+};
+
+//! reverse Cuthill-McKee ordering of a symmetric pattern, returns the new
+//! index of each row. Each connected component is traversed breadth first
+//! from a vertex of small degree far away from the others, neighbors are
+//! visited in order of increasing degree and the result is reversed.
+inline std::vector<int> reverseCuthillMcKee (const CSRPattern& pattern)
+{
+  typedef CSRPattern::size_type size_type;
+  const size_type n = pattern.rows();
+
+  std::vector<int> order;
+  order.reserve(n);
+  std::vector<int> level(n,-1);
+  std::vector<int> neighbors;
+
+  // breadth first search from start, appends the visited vertices to order
+  // and returns the last one, which lies on the last level
+  auto bfs = [&] (int start, std::vector<int>& visited)
+  {
+    const size_type first = visited.size();
+    visited.push_back(start);
+    level[start] = 0;
+    for (size_type k=first; k<visited.size(); k++)
+    {
+      const int v = visited[k];
+      neighbors.clear();
+      for (const int* j=pattern.begin(v); j!=pattern.end(v); ++j)
+        if (level[*j] < 0)
+        {
+          level[*j] = level[v]+1;
+          neighbors.push_back(*j);
+        }
+      std::sort(neighbors.begin(),neighbors.end(),[&pattern] (int a, int b)
+      {
+        return pattern.rowSize(a) < pattern.rowSize(b);
+      });
+      visited.insert(visited.end(),neighbors.begin(),neighbors.end());
+    }
+    return visited.back();
+  };
+
+  std::vector<int> component;
+  for (size_type s=0; s<n; s++)
+  {
+    if (level[s] >= 0)
+      continue;
+
+    // find a pseudo-peripheral start vertex: restart the search from the
+    // last vertex found as long as the number of levels grows
+    component.clear();
+    int last = bfs(s,component);
+    int depth = level[last];
+    for (int iter=0; iter<5; iter++)
+    {
+      for (int v : component)
+        level[v] = -1;
+      component.clear();
+      last = bfs(last,component);
+      if (level[last] <= depth)
+        break;
+      depth = level[last];
+    }
+    order.insert(order.end(),component.begin(),component.end());
+  }
+
+  std::vector<int> permutation(n);
+  for (size_type k=0; k<n; k++)
+    permutation[order[n-1-k]] = k;
+  return permutation;
+}
+
+#endif // __DUNE_GRID_HOWTO_CSRPATTERN_HH__
@@ -0,0 +1,125 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_EMBEDDEDQUADRATURE_HH__
+#define __DUNE_GRID_HOWTO_EMBEDDEDQUADRATURE_HH__
+
+#include <cmath>
+#include <vector>
+
+#include <dune/common/fvector.hh>
+#include <dune/geometry/quadraturerules.hh>
+#include <dune/geometry/type.hh>
+
+// EmbeddedQuadratureRule:
+// a quadrature rule of order 3 whose points contain those of a rule of
+// order 1, so both rules need the function values at the same points
+// only. The weights of the order 1 rule are stored relative to those of
+// the order 3 rule, lowFactor(i) = w_low(i)/w_high(i), and are zero at
+// the points not used by it.
+template<class ctype, int dim>
+class EmbeddedQuadratureRule : public Dune::QuadratureRule<ctype,dim>
+{
+public:
+  enum { lowOrder = 1, highOrder = 3 };
+
+  typedef Dune::FieldVector<ctype,dim> Coordinate;
+
+  EmbeddedQuadratureRule (Dune::GeometryType gt)
+    : Dune::QuadratureRule<ctype,dim>(gt,highOrder)
+  {}
+
+  ctype lowFactor (int i) const
+  {
+    return lowFactors_[i];
+  }
+
+  // add a point with its weights in both rules
+  void add (const Coordinate& x, ctype highWeight, ctype lowWeight)
+  {
+    this->push_back(Dune::QuadraturePoint<ctype,dim>(x,highWeight));
+    lowFactors_.push_back(lowWeight/highWeight);
+  }
+
+private:
+  std::vector<ctype> lowFactors_;
+};
+
+// EmbeddedQuadratureRules:
+// singleton holding embedded rules for simplices and cubes, the order 1
+// rule is the midpoint rule in each case:
+//  - triangle: Strang and Fix, the center and 3 points, order 3
+//  - tetrahedron: Keast, the center and 4 points, order 3
+//  - line and cubes: the center and the 2^dim points on the diagonals at
+//    distance sqrt(2/3)/2 in each direction, order 3 by symmetry. These
+//    are 1+2^dim evaluations, as many as for the midpoint rule and the
+//    tensor Gauss rule of order 3 together, so cubes gain nothing. A
+//    subset of the 2^dim points of an order 3 rule that is exact for
+//    linear functions does not detect all quadratic terms, e.g. x^2+y^2,
+//    so it is no useful error estimator.
+template<class ctype, int dim>
+class EmbeddedQuadratureRules
+{
+public:
+  typedef EmbeddedQuadratureRule<ctype,dim> Rule;
+  typedef typename Rule::Coordinate Coordinate;
+
+  // the embedded rule for the given type or nullptr if there is none
+  static const Rule* rule (const Dune::GeometryType& gt)
+  {
+    static const EmbeddedQuadratureRules rules;
+    if (gt.isSimplex() && dim <= 3)
+      return &rules.simplex_;
+    if (gt.isCube())
+      return &rules.cube_;
+    return nullptr;
+  }
+
+private:
+  EmbeddedQuadratureRules ()
+    : simplex_(Dune::GeometryTypes::simplex(dim)), cube_(Dune::GeometryTypes::cube(dim))
+  {
+    // cube: center weight 1/2, the other half is shared by the corners of
+    // a cube of edge length sqrt(2/3) around it
+    const ctype a = 0.5*std::sqrt(2.0/3.0);
+    cube_.add(Coordinate(0.5), 0.5, 1.0);
+    for (int c = 0; c < (1 << dim); c++)
+    {
+      Coordinate x;
+      for (int d = 0; d < dim; d++)
+        x[d] = (c & (1 << d)) ? 0.5+a : 0.5-a;
+      cube_.add(x, 0.5/(1 << dim), 0.0);
+    }
+
+    if constexpr (dim == 1)
+      simplex_ = cube_;
+    else if constexpr (dim == 2)
+    {
+      // the weights sum up to the area 1/2
+      simplex_.add(Coordinate(1.0/3.0), -27.0/96.0, 0.5);
+      for (int i = 0; i < 3; i++)
+        simplex_.add(permutation(0.6, 0.2, i), 25.0/96.0, 0.0);
+    }
+    else if constexpr (dim == 3)
+    {
+      // the weights sum up to the volume 1/6
+      simplex_.add(Coordinate(0.25), -2.0/15.0, 1.0/6.0);
+      for (int i = 0; i < 4; i++)
+        simplex_.add(permutation(0.5, 1.0/6.0, i), 3.0/40.0, 0.0);
+    }
+  }
+
+  // the point with barycentric coordinate a at corner i and b at the
+  // other corners, corner 0 is the origin
+  static Coordinate permutation (ctype a, ctype b, int i)
+  {
+    Coordinate x(b);
+    if (i > 0)
+      x[i-1] = a;
+    return x;
+  }
+
+  Rule simplex_;
+  Rule cube_;
+};
+
+#endif // __DUNE_GRID_HOWTO_EMBEDDEDQUADRATURE_HH__
@@ -1,15 +1,27 @@
 // -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
 // vi: set et ts=4 sw=2 sts=2:
 #include <config.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
-#include <set>
+#include <dune/common/exceptions.hh>
 #include <dune/common/fvector.hh>
 #include <dune/common/fmatrix.hh>
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
+#include <dune/common/timer.hh>
 #include <dune/geometry/quadraturerules.hh>
 #include <dune/geometry/referenceelements.hh>
+#include <dune/grid/common/capabilities.hh>
 #include <dune/grid/io/file/vtk/vtkwriter.hh>
 #include <dune/grid/albertagrid.hh>
+#include <dune/grid/yaspgrid.hh>
 
 #if HAVE_DUNE_ISTL
 #include <dune/istl/bvector.hh>
@@ -19,16 +31,26 @@
 #include <dune/istl/solvers.hh>
 #include <dune/istl/preconditioners.hh>
 #include <dune/istl/io.hh>
+#include <dune/istl/paamg/amg.hh>
+#include "p1matrixfree.hh"
+#include "p1multigrid.hh"
+#include "qkoperator.hh"
 #else
 #include <dune/common/dynvector.hh>
-#include <dune/common/dynmatrix.hh>
+#include "csrmatrix.hh"
 #endif // HAVE_DUNE_ISTL
 
+#include "affinegeometry.hh"
+#include "fixedquadrature.hh"
 #include "shapefunctions.hh"
+#include "p1batchkernel.hh"
+#include "qkshapefunctions.hh"
+#include "csrpattern.hh"
 
 // P1Elements:
 // a P1 finite element discretization for elliptic problems Dirichlet
-// boundary conditions on simplicial conforming grids
+// boundary conditions on simplicial conforming grids, cubes are
+// discretized by Q1 elements
 template<class GV, class F>
 class P1Elements
 {
@@ -36,223 +58,789 @@ public:
   static const int dim = GV::dimension;
 
   typedef typename GV::ctype ctype;
+
+  // true if the grid consists of cubes only
+  static const bool cubeGrid = Dune::Capabilities::hasSingleGeometryType<typename GV::Grid>::v
+    && Dune::Capabilities::hasSingleGeometryType<typename GV::Grid>::topologyId == (1u << dim) - 1;
+
 #if HAVE_DUNE_ISTL
   typedef Dune::BCRSMatrix<Dune::FieldMatrix<ctype,1,1> > Matrix;
   typedef Dune::BlockVector<Dune::FieldVector<ctype,1> > ScalarField;
 #else
-  typedef Dune::DynamicMatrix<ctype> Matrix;
+  typedef CSRMatrix<ctype> Matrix;
   typedef Dune::DynamicVector<ctype> ScalarField;
 #endif // HAVE_DUNE_ISTL
 
 private:
+  typedef typename GV::template Codim<0>::Entity Element;
+  typedef typename Element::EntitySeed ElementSeed;
   typedef typename GV::template Codim<0>::Iterator LeafIterator;
   typedef typename GV::template Codim<0>::Geometry::JacobianInverseTransposed JacobianInverseTransposed;
   typedef typename GV::IntersectionIterator IntersectionIterator;
   typedef typename GV::IndexSet LeafIndexSet;
 
+  // maximal number of vertices of an element, dim+1 for simplices and
+  // 2^dim for cubes
+  static const int n = 1 << dim;
+  typedef Dune::FieldMatrix<ctype,n,n> LocalMatrix;
+  typedef Dune::FieldVector<ctype,n> LocalVector;
+
   const GV& gv;
   const F& f;
 
+  // elements grouped by color, no two elements of one color share a vertex
+  std::vector< std::vector<ElementSeed> > colors;
+
+  // compute local stiffness matrix and right side of one element and the
+  // global indices of its vertices, returns the number of vertices
+  int assembleElement(const Element& element, int* index,
+                      LocalMatrix& localA, LocalVector& localb) const;
+
+  // add the local contributions of one element to A and b
+  void scatterElement(int vertexsize, const int* index,
+                      const LocalMatrix& localA, const LocalVector& localb);
+
+  // greedy coloring of the elements for the threaded assembly
+  void colorElements();
+
+  // number of elements assembled at once by the batch kernel, a multiple
+  // of the SIMD width for double on current processors
+  static const int batchWidth = 8;
+  typedef P1BatchKernel<ctype,dim,batchWidth> BatchKernel;
+
+  // ElementAssembler:
+  // assembles and scatters the elements passed to add(), either one at
+  // a time or, with batchAssembly, affine simplices in batches of
+  // batchWidth. Each thread uses its own assembler.
+  class ElementAssembler
+  {
+  public:
+    ElementAssembler(P1Elements& p1_) : p1(p1_), lanes(0) {}
+
+    void add(const Element& element)
+    {
+      if (!p1.batchAssembly || cubeGrid || !element.type().isSimplex()
+          || !element.geometry().affine())
+      {
+        int vertexsize = p1.assembleElement(element, index, localA, localb);
+        p1.scatterElement(vertexsize, index, localA, localb);
+        return;
+      }
+
+      for (int i = 0; i < dim+1; i++)
+        batchIndex[lanes][i] = p1.vertexIndex(element,i);
+      kernel.load(lanes, element.geometry());
+      if (++lanes == batchWidth)
+        flush();
+    }
+
+    // assemble the elements of an incomplete batch
+    void flush()
+    {
+      if (lanes == 0)
+        return;
+      // the matrix-free mode only needs the right sides
+      if (p1.matrixFree)
+        kernel.jacobians();
+      else
+        kernel.computeMatrices();
+      // the same rule as in assembleElement() for affine simplices
+      typedef FixedSimplexRule<ctype,dim,2> RightSideRule;
+      if constexpr (RightSideRule::available)
+        kernel.template computeRightSides<RightSideRule>(p1.f, lanes);
+      else
+        kernel.computeRightSides(p1.f, *p1.table2, lanes);
+      for (int l = 0; l < lanes; l++)
+      {
+        for (int i = 0; i < dim+1; i++)
+        {
+          if (!p1.matrixFree)
+            for (int j = 0; j < dim+1; j++)
+              localA[i][j] = kernel.A[i][j][l];
+          localb[i] = kernel.b[i][l];
+        }
+        p1.scatterElement(dim+1, batchIndex[l], localA, localb);
+      }
+      kernel.clear();
+      lanes = 0;
+    }
+
+  private:
+    P1Elements& p1;
+    BatchKernel kernel;
+    int batchIndex[batchWidth][dim+1];
+    int index[n];
+    int lanes;
+    LocalMatrix localA;
+    LocalVector localb;
+  };
+
+  // shape function values and gradients at the quadrature points of the
+  // simplex rules of order one and two, looked up once per assembly
+  typedef typename P1ShapeFunctionSet<ctype,ctype,dim>::Table ShapeFunctionTable;
+  const ShapeFunctionTable* table1;
+  const ShapeFunctionTable* table2;
+
+  // index of the i-th vertex of an element in the numbering of A, b and u
+  int vertexIndex(const Element& element, int i) const
+  {
+    const int k = gv.indexSet().subIndex(element,i,dim);
+    return permutation.empty() ? k : permutation[k];
+  }
+
 public:
   Matrix A;
   ScalarField b;
   ScalarField u;
-  std::vector< std::set<int> > adjacencyPattern;
+  CSRPattern adjacencyPattern;
+
+  // true for vertices on the Dirichlet boundary
+  std::vector<bool> dirichlet;
+
+  // new index of each vertex of the index set, empty if the vertices
+  // are not reordered
+  std::vector<int> permutation;
+
+  // if true, the Dirichlet columns are eliminated as well, so that A is
+  // symmetric and CG or symmetric preconditioners can be used
+  bool symmetricDirichlet;
+
+  // if true, A is not assembled and solve() applies the stiffness matrix
+  // element by element, with element gradients recomputed in each
+  // application or cached if cacheGradients is set. The cache takes about
+  // as much memory as A, so it is off by default.
+  bool matrixFree;
+  bool cacheGradients;
+
+  // if true, affine simplices are assembled in batches by P1BatchKernel
+  bool batchAssembly;
 
-  P1Elements(const GV& gv_, const F& f_) : gv(gv_), f(f_) {}
+  P1Elements(const GV& gv_, const F& f_)
+    : gv(gv_), f(f_), table1(nullptr), table2(nullptr), symmetricDirichlet(false),
+      matrixFree(false), cacheGradients(false), batchAssembly(false) {}
 
-  // store adjacency information in a vector of sets
+  // store adjacency information in compressed row storage
   void determineAdjacencyPattern();
 
-  // assemble stiffness matrix A and right side b
-  void assemble();
+  // renumber the vertices by the reverse Cuthill-McKee method to reduce
+  // the bandwidth of A, needs the adjacency pattern which is rebuilt
+  void reorderVertices();
 
-  // finally solve Au = b for u
-  void solve();
+  // assemble stiffness matrix A and right side b, using the given number
+  // of threads which concurrently process elements of the same color
+  void assemble(int threads = 1);
+
+  // iteration count and timings of one linear solve
+  struct SolverStatistics
+  {
+    int iterations;
+    bool converged;
+    double reduction;
+    double setupTime;
+    double solveTime;
+    std::size_t operatorBytes;
+  };
+
+  // finally solve Au = b for u with the given preconditioner and Krylov
+  // method: "ilu-bicgstab", "ilu-cg", "amg-bicgstab", "amg-cg",
+  // "gmg-bicgstab" or "gmg-cg", and "jacobi-cg" or "chebyshev-cg" in the
+  // matrix-free mode. Without dune-istl only "jacobi-cg" is available.
+  // With warmStart the current u is the initial guess.
+  SolverStatistics solve(const std::string& solverType = "ilu-bicgstab",
+                         double reduction = 1e-15, bool warmStart = false);
+
+  // u in the numbering of the index set of the grid view
+  ScalarField solution() const;
+
+  // set u from a vector in the numbering of the index set of the grid view
+  void setSolution(const ScalarField& v);
 };
 
 template<class GV, class F> /*@\label{fem:adjpat1}@*/
 void P1Elements<GV, F>::determineAdjacencyPattern()
 {
   const int N = gv.size(dim);
-  adjacencyPattern.resize(N);
 
-  const LeafIndexSet& set = gv.indexSet();
   const LeafIterator itend = gv.template end<0>();
 
-  for (LeafIterator it = gv.template begin<0>(); it != itend; ++it)
+  // all vertices of a simplex are pairwise adjacent, so each element
+  // couples all of its vertices with each other
+  adjacencyPattern.build(N, [&](auto addCouplings)
   {
-    auto geo = it->geometry();
-    auto ref = referenceElement(geo);
-
-    // traverse all codim-1-entities of the current element and store all
-    // pairs of vertices in adjacencyPattern
-    const IntersectionIterator isend = gv.iend(*it);
-    for (IntersectionIterator is = gv.ibegin(*it) ; is != isend ; ++is)
+    for (LeafIterator it = gv.template begin<0>(); it != itend; ++it)
     {
-      int vertexsize = ref.size(is->indexInInside(),1,dim);
+      const int vertexsize = it->subEntities(dim);
+      int index[1<<dim];
       for (int i=0; i < vertexsize; i++)
+        index[i] = vertexIndex(*it,i);
+      addCouplings(index, vertexsize, index, vertexsize);
+    }
+  });
+
+  // the element coloring depends on the grid as well
+  colors.clear();
+} /*@\label{fem:adjpat2}@*/
+
+template<class GV, class F>
+void P1Elements<GV, F>::reorderVertices()
+{
+  if (matrixFree)
+    DUNE_THROW(Dune::NotImplemented, "vertex reordering needs an assembled matrix");
+
+  // the ordering is computed from the pattern in the original numbering
+  permutation.clear();
+  determineAdjacencyPattern();
+  permutation = reverseCuthillMcKee(adjacencyPattern);
+  determineAdjacencyPattern();
+}
+
+template<class GV, class F>
+int P1Elements<GV, F>::assembleElement(const Element& element, int* index,
+                                       LocalMatrix& localA, LocalVector& localb) const
+{
+  // get a set of P1 shape functions
+  const P1ShapeFunctionSet<ctype,ctype,dim>& basis = P1ShapeFunctionSet<ctype,ctype,dim>::instance();
+
+  // determine geometry of the current element and get the matching reference element
+  const auto geo = element.geometry();
+  auto ref = referenceElement(geo);
+  int vertexsize = ref.size(dim);
+
+  // gain global indices of all vertices once per element
+  for (int i = 0; i < vertexsize; i++)
+    index[i] = vertexIndex(element,i);
+
+  localA = 0.0;
+  localb = 0.0;
+  Dune::FieldVector<ctype,dim> grad[n];
+
+  Dune::GeometryType gt = element.type();
+  if (gt.isCube())
+  {
+    // tensor-product Q1 elements, computed by the sum-factorized kernel
+    // whose numbering of the shape functions is that of the vertices
+    const QkTensorKernel<ctype,dim,1>& kernel = QkTensorKernel<ctype,dim,1>::instance();
+    if (!matrixFree)
+    {
+      typename QkTensorKernel<ctype,dim,1>::GeometryTensors G;
+      kernel.geometryTensors(geo, G);
+      kernel.localMatrix(G, localA);
+    }
+    kernel.rightHandSide(geo, f, localb);
+    return vertexsize;
+  }
+
+  // the affine map of the element, if it is affine, the local matrix is
+  // not needed in the matrix-free mode
+  AffineGeometryCache<ctype,dim,GV::dimensionworld> affine;
+  affine.bind(geo);
+  if (!matrixFree && affine.affine())
+  {
+    // on affine simplices the transformed gradients are constant, so they
+    // are computed once and the element volume replaces the quadrature
+    const Dune::FieldVector<ctype,dim>& center = ref.position(0,0);
+    const ctype volume = geo.volume();
+    for (int i = 0; i < vertexsize; i++)
+      affine.jacobianInverseTransposed().mv(basis[i].evaluateGradient(center),grad[i]);
+    for (int i = 0; i < vertexsize; i++)
+      for (int j = i; j < vertexsize; j++)
+        localA[i][j] = localA[j][i] = (grad[i]*grad[j]) * volume;   /*@\label{fem:calca}@*/
+  }
+  else if (!matrixFree)
+  {
+    // shape function gradients at the points of the quadrature rule of
+    // order one for the given geometry type
+    const ShapeFunctionTable& table = (table1 && gt == Dune::GeometryTypes::simplex(dim))
+                                      ? *table1 : basis.table(gt,1);
+    for (int q = 0; q < table.size(); q++)
+    {
+      // compute the jacobian inverse transposed to transform the gradients
+      const JacobianInverseTransposed jacInvTra =
+        geo.jacobianInverseTransposed(table.position(q));
+
+      // get the weight at the current quadrature point and the Jacobian
+      // determinant for the transformation formula
+      ctype factor = table.weight(q) * geo.integrationElement(table.position(q));
+
+      // compute transformed gradients
+      const Dune::FieldVector<ctype,dim>* refGrad = table.gradients(q);
+      for (int i = 0; i < vertexsize; i++)
+        jacInvTra.mv(refGrad[i],grad[i]);
+      for (int i = 0; i < vertexsize; i++)
+        for (int j = 0; j < vertexsize; j++)
+          localA[i][j] += (grad[i]*grad[j]) * factor;
+    }
+  }
+
+  // on affine simplices the right side is integrated with a rule of order
+  // two fixed at compile time, the shape functions are the barycentric
+  // coordinates of the points
+  typedef FixedSimplexRule<ctype,dim,2> RightSideRule;
+  if constexpr (RightSideRule::available)
+    if (affine.affine() && gt.isSimplex())
+    {
+      for (int q = 0; q < RightSideRule::size; q++)
       {
-        int indexi = set.subIndex(*it,ref.subEntity(is->indexInInside(),1,i,dim),dim);
-        for (int j=0; j < vertexsize; j++)
+        const Dune::FieldVector<ctype,dim> x = fixedRulePoint<RightSideRule,ctype,dim>(q);
+        const ctype factor = RightSideRule::weights[q] * affine.integrationElement() * f(affine.global(x));
+        ctype phi0 = 1.0;
+        for (int d = 0; d < dim; d++)
         {
-          int indexj = set.subIndex(*it,ref.subEntity(is->indexInInside(),1,j,dim),dim);
-          adjacencyPattern[indexi].insert(indexj);
+          localb[d+1] += x[d] * factor;
+          phi0 -= x[d];
         }
+        localb[0] += phi0 * factor;
       }
+      return vertexsize;
+    }
+
+  // shape function values at the points of the quadrature rule of order
+  // two for the given geometry type
+  const ShapeFunctionTable& table = (table2 && gt == Dune::GeometryTypes::simplex(dim))
+                                    ? *table2 : basis.table(gt,2);
+  for (int q = 0; q < table.size(); q++)
+  {
+    ctype weight = table.weight(q);
+    ctype detjac = affine.affine() ? affine.integrationElement()
+                   : geo.integrationElement(table.position(q));
+    ctype fglobal = f(affine.affine() ? affine.global(table.position(q))
+                      : geo.global(table.position(q)));
+    const ctype* phi = table.values(q);
+    for (int i = 0 ; i<vertexsize; i++)
+    {
+      // evaluate the integrand of the right side
+      ctype fval = phi[i] * fglobal;
+      localb[i] += fval * weight * detjac;              /*@\label{fem:calcb}@*/
     }
   }
-} /*@\label{fem:adjpat2}@*/
+
+  return vertexsize;
+}
 
 template<class GV, class F>
-void P1Elements<GV, F>::assemble()
+void P1Elements<GV, F>::scatterElement(int vertexsize, const int* index,
+                                       const LocalMatrix& localA, const LocalVector& localb)
 {
-  const int N = gv.size(dim);
+  // update the matrix entries associated with vertices i and j
+  for (int i = 0; i < vertexsize; i++)
+  {
+    if (!matrixFree)
+    {
+      auto&& row = A[index[i]];
+      for (int j = 0; j < vertexsize; j++)
+        row[index[j]] += localA[i][j];
+    }
+    b[index[i]] += localb[i];
+  }
+}
 
+template<class GV, class F>
+void P1Elements<GV, F>::colorElements()
+{
   const LeafIndexSet& set = gv.indexSet();
   const LeafIterator itend = gv.template end<0>();
 
-  // set sizes of A and b
-#if HAVE_DUNE_ISTL
-  A.setSize(N, N, N + 2*gv.size(dim-1));
-  A.setBuildMode(Matrix::random);
-  b.resize(N);
+  // for each vertex a bit mask of the colors of its elements
+  std::vector<std::uint64_t> vertexColors(gv.size(dim), 0);
 
-  for (int i = 0; i < N; i++)
-    A.setrowsize(i,adjacencyPattern[i].size());
-  A.endrowsizes();
-
-  // set sparsity pattern of A with the information gained in determineAdjacencyPattern
-  for (int i = 0; i < N; i++)   /*@\label{fem:setpattern}@*/
+  colors.clear();
+  for (LeafIterator it = gv.template begin<0>(); it != itend; ++it)
   {
-    std::template set<int>::iterator setend = adjacencyPattern[i].end();
-    for (std::template set<int>::iterator setit = adjacencyPattern[i].begin();
-         setit != setend; ++setit)
-      A.addindex(i,*setit);
+    const int vertexsize = it->subEntities(dim);
+
+    // colors already taken by a neighbor sharing a vertex
+    std::uint64_t taken = 0;
+    for (int i = 0; i < vertexsize; i++)
+      taken |= vertexColors[set.subIndex(*it,i,dim)];
+    if (~taken == 0)
+      DUNE_THROW(Dune::Exception, "more than 64 element colors needed");
+
+    // choose the smallest free color
+    int color = 0;
+    while (taken & (std::uint64_t(1) << color))
+      ++color;
+
+    for (int i = 0; i < vertexsize; i++)
+      vertexColors[set.subIndex(*it,i,dim)] |= std::uint64_t(1) << color;
+    if (color >= int(colors.size()))
+      colors.resize(color+1);
+    colors[color].push_back(it->seed());
   }
+}
 
-  A.endindices();   /*@\label{fem:endindices}@*/
-#else
-  A.resize(N, N);
+template<class GV, class F>
+void P1Elements<GV, F>::assemble(int threads)
+{
+  const int N = gv.size(dim);
+
+  const LeafIterator itend = gv.template end<0>();
+
+  // set sizes of A and b
   b.resize(N);
+
+  // set sparsity pattern of A with the information gained in
+  // determineAdjacencyPattern, passing the column indices row by row
+  if (!matrixFree)
+#if HAVE_DUNE_ISTL
+    adjacencyPattern.setupMatrix(A, N);   /*@\label{fem:setpattern}@*/
+#else
+    A.setPattern(adjacencyPattern);
 #endif // HAVE_DUNE_ISTL
 
   // initialize A and b
-  A = 0.0;
+  if (!matrixFree)
+    A = 0.0;
   b = 0.0;
 
-  // get a set of P1 shape functions
+  // the tables are shared by all threads, so they are fetched before
+  // the element loop instead of locking the cache for each element
   const P1ShapeFunctionSet<ctype,ctype,dim>& basis = P1ShapeFunctionSet<ctype,ctype,dim>::instance();
+  table1 = &basis.table(Dune::GeometryTypes::simplex(dim),1);
+  table2 = &basis.table(Dune::GeometryTypes::simplex(dim),2);
 
-  for (LeafIterator it = gv.template begin<0>(); it != itend; ++it)   /*@\label{fem:loop1}@*/
-  {
-    // determine geometry of the current element and get the matching reference element
-    auto geo = it->geometry();
-    auto ref = referenceElement(geo);
-    int vertexsize = ref.size(dim);
+  // Elements of one color do not share vertices, so their contributions
+  // go to distinct rows and entries of A and b and can be added
+  // concurrently. Colors are processed one after the other, also by the
+  // sequential loop, so each entry receives its contributions in the same
+  // order for any number of threads and the result does not depend on it.
+  if (colors.empty())
+    colorElements();
 
-    // get a quadrature rule of order one for the given geometry type
-    Dune::GeometryType gt = it->type();
-    const Dune::QuadratureRule<ctype,dim>& rule = Dune::QuadratureRules<ctype,dim>::rule(gt,1);
-    for (typename Dune::QuadratureRule<ctype,dim>::const_iterator r = rule.begin();
-         r != rule.end() ; ++r)
+  if (threads <= 1)
+  {
+    ElementAssembler assembler(*this);
+    for (const std::vector<ElementSeed>& color : colors)   /*@\label{fem:loop1}@*/
+      for (const ElementSeed& seed : color)
+        assembler.add(gv.grid().entity(seed));
+    /*@\label{fem:loop2}@*/
+    assembler.flush();
+  }
+  else
+  {
+    std::vector<Element> elements;
+    for (const std::vector<ElementSeed>& color : colors)
     {
-      // compute the jacobian inverse transposed to transform the gradients
-      JacobianInverseTransposed jacInvTra =
-        it->geometry().jacobianInverseTransposed(r->position());
-
-      // get the weight at the current quadrature point
-      ctype weight = r->weight();
+      // the entities are created before the threads start, which then
+      // only read them and the grid
+      elements.clear();
+      elements.reserve(color.size());
+      for (const ElementSeed& seed : color)
+        elements.push_back(gv.grid().entity(seed));
 
-      // compute Jacobian determinant for the transformation formula
-      ctype detjac = it->geometry().integrationElement(r->position());
-      for (int i = 0; i < vertexsize; i++)
-      {
-        // compute transformed gradients
-        Dune::FieldVector<ctype,dim> grad1;
-        jacInvTra.mv(basis[i].evaluateGradient(r->position()),grad1);
-        for (int j = 0; j < vertexsize; j++)
+      const std::size_t chunk = (elements.size() + threads - 1) / threads;
+      std::vector<std::thread> workers;
+      for (int t = 0; t < threads; t++)
+        workers.emplace_back([this, &elements, chunk, t] ()
         {
-          Dune::FieldVector<ctype,dim> grad2;
-          jacInvTra.mv(basis[j].evaluateGradient(r->position()),grad2);
-
-          // gain global inidices of vertices i and j and update associated matrix entry
-          A[set.subIndex(*it,i,dim)][set.subIndex(*it,j,dim)]           /*@\label{fem:calca}@*/
-            += (grad1*grad2) * weight * detjac;
-        }
-      }
+          ElementAssembler assembler(*this);
+          const std::size_t begin = std::min(elements.size(), t*chunk);
+          const std::size_t end = std::min(elements.size(), begin+chunk);
+          for (std::size_t k = begin; k < end; k++)
+            assembler.add(elements[k]);
+          assembler.flush();
+        });
+      for (std::thread& worker : workers)
+        worker.join();
     }
-
-    // get a quadrature rule of order two for the given geometry type
-    const Dune::QuadratureRule<ctype,dim>& rule2 = Dune::QuadratureRules<ctype,dim>::rule(gt,2);
-    for (typename Dune::QuadratureRule<ctype,dim>::const_iterator r = rule2.begin();
-         r != rule2.end() ; ++r)
-    {
-      ctype weight = r->weight();
-      ctype detjac = it->geometry().integrationElement(r->position());
-      for (int i = 0 ; i<vertexsize; i++)
-      {
-        // evaluate the integrand of the right side
-        ctype fval = basis[i].evaluateFunction(r->position())
-                     * f(it->geometry().global(r->position())) ;
-        b[set.subIndex(*it,i,dim)] += fval * weight * detjac;         /*@\label{fem:calcb}@*/
-      }
-    }
-  }   /*@\label{fem:loop2}@*/
+  }
 
   // Dirichlet boundary conditions:
-  // replace lines in A related to Dirichlet vertices by trivial lines
+  // mark all vertices on the boundary
+  dirichlet.assign(N, false);
   for ( LeafIterator it = gv.template begin<0>() ; it != itend ; ++it)   /*@\label{fem:boundary1}@*/
   {
+    // determine geometry of the current element and get the matching reference element
+    auto geo = it->geometry();
+    auto ref = referenceElement(geo);
+
     const IntersectionIterator isend = gv.iend(*it);
     for (IntersectionIterator is = gv.ibegin(*it) ; is != isend ; ++is)
     {
-      // determine geometry of the current element and get the matching reference element
-      auto geo = it->geometry();
-      auto ref = referenceElement(geo);
-
       // check whether current intersection is on the boundary
       if ( is->boundary() )
       {
         // traverse all vertices the intersection consists of
         for (int i=0; i < ref.size(is->indexInInside(),1,dim); i++)
-        {
-          // and replace the associated line of A and b with a trivial one
-          int indexi = set.subIndex(*it,ref.subEntity(is->indexInInside(),1,i,dim),dim);
+          dirichlet[vertexIndex(*it,ref.subEntity(is->indexInInside(),1,i,dim))] = true;
+      }
+    }
+  }
+
+  // homogeneous Dirichlet values
+  const ctype g = 0.0;
 
-          A[indexi] = 0.0;           /*@\label{fem:trivialline}@*/
-          A[indexi][indexi] = 1.0;
-          b[indexi] = 0.0;
+  // move the columns of Dirichlet vertices to the right side, so the
+  // remaining system keeps the symmetry of the Laplacian. The matrix-free
+  // operator always eliminates symmetrically, with homogeneous values
+  // nothing has to be moved to b then.
+  if (symmetricDirichlet && !matrixFree)
+  {
+    for (auto row = A.begin(); row != A.end(); ++row)
+    {
+      if (dirichlet[row.index()])
+        continue;
+      for (auto col = row->begin(); col != row->end(); ++col)
+        if (dirichlet[col.index()])
+        {
+          const ctype aij = *col;
+          b[row.index()] -= aij * g;
+          *col = 0.0;
         }
-      }
     }
+  }
+
+  // replace lines in A related to Dirichlet vertices by trivial lines
+  for (int i = 0; i < N; i++)
+  {
+    if (!dirichlet[i])
+      continue;
+
+    if (!matrixFree)
+    {
+      A[i] = 0.0;           /*@\label{fem:trivialline}@*/
+      A[i][i] = 1.0;
+    }
+    b[i] = g;
   }   /*@\label{fem:boundary2}@*/
 }
 
 #if HAVE_DUNE_ISTL
 template<class GV, class E>
-void P1Elements<GV, E>::solve()
+typename P1Elements<GV, E>::SolverStatistics
+P1Elements<GV, E>::solve(const std::string& solverType, double reduction,
+                         bool warmStart)
 {
-  // make linear operator from A
-  Dune::MatrixAdapter<Matrix,ScalarField,ScalarField> op(A);
+  typedef Dune::MatrixAdapter<Matrix,ScalarField,ScalarField> Operator;
+  typedef typename std::conditional<cubeGrid,
+      QkMatrixFreeOperator<GV,ScalarField,1>,
+      P1MatrixFreeOperator<GV,ScalarField> >::type MatrixFreeOperator;
+  typedef Dune::LinearOperator<ScalarField,ScalarField> LinearOperator;
+  typedef Dune::Preconditioner<ScalarField,ScalarField> Preconditioner;
+  typedef Dune::InverseOperator<ScalarField,ScalarField> Solver;
 
-  // initialize preconditioner
-  Dune::SeqILU<Matrix,ScalarField,ScalarField> ilu1(A, 1, 0.92);
+  // split solverType into preconditioner and Krylov method
+  const std::string::size_type dash = solverType.find('-');
+  const std::string precType = solverType.substr(0, dash);
+  const std::string krylovType = (dash == std::string::npos) ? "" : solverType.substr(dash+1);
+
+  SolverStatistics stats;
+  Dune::Timer timer;
+
+  std::shared_ptr<LinearOperator> op;
+  std::shared_ptr<Preconditioner> prec;
+  if (matrixFree)
+  {
+    // make matrix-free operator and initialize preconditioner
+    std::shared_ptr<MatrixFreeOperator> mfop
+      = std::make_shared<MatrixFreeOperator>(gv, dirichlet, cacheGradients);
+    if (precType == "jacobi")
+      prec = std::make_shared<MatrixFreeJacobi<MatrixFreeOperator,ScalarField> >(*mfop);
+    else if (precType == "chebyshev")
+      prec = std::make_shared<MatrixFreeChebyshev<MatrixFreeOperator,ScalarField> >(*mfop);
+    else
+      DUNE_THROW(Dune::Exception, "unknown matrix-free preconditioner " << precType);
+    stats.operatorBytes = mfop->memory();
+    op = mfop;
+  }
+  else
+  {
+    // make linear operator from A
+    std::shared_ptr<Operator> matop = std::make_shared<Operator>(A);
+
+    // initialize preconditioner
+    if (precType == "ilu")
+      prec = std::make_shared<Dune::SeqILU<Matrix,ScalarField,ScalarField> >(A, 1, 0.92);
+    else if (precType == "amg")
+    {
+      // aggregation based AMG with one symmetric Gauss-Seidel sweep for
+      // pre- and postsmoothing, suited for the symmetric Laplacian
+      typedef Dune::SeqSSOR<Matrix,ScalarField,ScalarField> Smoother;
+      typedef Dune::Amg::CoarsenCriterion<
+          Dune::Amg::SymmetricCriterion<Matrix,Dune::Amg::FirstDiagonal> > Criterion;
+
+      typename Dune::Amg::SmootherTraits<Smoother>::Arguments smootherArgs;
+      smootherArgs.iterations = 1;
+      smootherArgs.relaxationFactor = 1.0;
+
+      Criterion criterion(15, 2000);
+      criterion.setDefaultValuesIsotropic(dim);
+      criterion.setDebugLevel(0);
+
+      prec = std::make_shared<Dune::Amg::AMG<Operator,ScalarField,Smoother> >(*matop, criterion, smootherArgs);
+    }
+    else if (precType == "gmg")
+    {
+      // geometric multigrid on the refinement hierarchy of the grid, its
+      // prolongations use the numbering of the leaf index set
+      if (!permutation.empty())
+        DUNE_THROW(Dune::NotImplemented, "geometric multigrid with reordered vertices");
+      if (cubeGrid)
+        DUNE_THROW(Dune::NotImplemented, "geometric multigrid on cubes");
+      if (gv.size(dim) != gv.grid().size(dim))
+        DUNE_THROW(Dune::NotImplemented, "geometric multigrid on a grid view other than the leaf");
+      typedef P1GeometricMultigrid<typename GV::Grid,Matrix,ScalarField> GMG;
+      prec = std::make_shared<GMG>(gv.grid(), A, dirichlet);
+    }
+    else
+      DUNE_THROW(Dune::Exception, "unknown preconditioner " << precType);
+
+    // values and column indices of the nonzeroes and the row offsets
+    stats.operatorBytes = A.nonzeroes()*(sizeof(typename Matrix::block_type)+sizeof(typename Matrix::size_type))
+                          + A.N()*sizeof(typename Matrix::size_type);
+    op = matop;
+  }
+
+  if (warmStart)
+  {
+    // the initial guess only has to be improved to the accuracy of a
+    // solve from zero, so the defect is reduced relative to the norm of b
+    ScalarField d(b);
+    op->applyscaleadd(-1.0, u, d);
+    const double defect = d.two_norm();
+    if (defect > 0.0)
+      reduction = std::min(1.0, reduction*b.two_norm()/defect);
+  }
+  else
+  {
+    // initialize u to some arbitrary value to avoid u being the exact
+    // solution
+    u.resize(b.N());
+    u = 2.0;
+  }
 
   // the inverse operator
-  Dune::BiCGSTABSolver<ScalarField> bcgs(op, ilu1, 1e-15, 5000, 0);
+  std::shared_ptr<Solver> solver;
+  if (krylovType == "bicgstab")
+    solver = std::make_shared<Dune::BiCGSTABSolver<ScalarField> >(*op, *prec, reduction, 5000, 0);
+  else if (krylovType == "cg")
+    solver = std::make_shared<Dune::CGSolver<ScalarField> >(*op, *prec, reduction, 5000, 0);
+  else
+    DUNE_THROW(Dune::Exception, "unknown Krylov method " << krylovType);
+  stats.setupTime = timer.elapsed();
+
+  // finally solve the system, on a copy of b as the solver overwrites
+  // the right side with the residual
+  ScalarField rhs(b);
   Dune::InverseOperatorResult r;
+  timer.reset();
+  solver->apply(u, rhs, r);
+  stats.solveTime = timer.elapsed();
+
+  stats.iterations = r.iterations;
+  stats.converged = r.converged;
+  stats.reduction = r.reduction;
+  return stats;
+}
+#else
+template<class GV, class E>
+typename P1Elements<GV, E>::SolverStatistics
+P1Elements<GV, E>::solve(const std::string& solverType, double reduction,
+                         bool warmStart)
+{
+  if (solverType != "jacobi-cg" || matrixFree)
+    DUNE_THROW(Dune::NotImplemented, "without dune-istl only the assembled jacobi-cg solver is available");
+  if (!symmetricDirichlet)
+    DUNE_THROW(Dune::Exception, "jacobi-cg needs the symmetric Dirichlet elimination");
 
-  // initialize u to some arbitrary value to avoid u being the exact
-  // solution
-  u.resize(b.N());
-  u = 2.0;
+  SolverStatistics stats;
+  Dune::Timer timer;
 
-  // finally solve the system
-  bcgs.apply(u, b, r);
+  if (warmStart)
+  {
+    // the initial guess only has to be improved to the accuracy of a
+    // solve from zero, so the defect is reduced relative to the norm of b
+    ScalarField d(b.size());
+    A.mv(u, d);
+    d -= b;
+    const double defect = d.two_norm();
+    if (defect > 0.0)
+      reduction = std::min(1.0, reduction*b.two_norm()/defect);
+  }
+  else
+  {
+    // initialize u to some arbitrary value to avoid u being the exact
+    // solution
+    u.resize(b.size());
+    u = 2.0;
+  }
+  stats.setupTime = timer.elapsed();
+
+  // solve with the built-in Jacobi preconditioned CG method
+  timer.reset();
+  ctype achieved;
+  stats.iterations = csrSolveCG(A, u, b, ctype(reduction), 5000, achieved);
+  stats.solveTime = timer.elapsed();
+
+  stats.converged = achieved <= reduction;
+  stats.reduction = achieved;
+  stats.operatorBytes = A.memory() + adjacencyPattern.nonzeroes()*sizeof(int)
+                        + (adjacencyPattern.rows()+1)*sizeof(CSRPattern::size_type);
+  return stats;
 }
 #endif // HAVE_DUNE_ISTL
 
+template<class GV, class F>
+typename P1Elements<GV, F>::ScalarField P1Elements<GV, F>::solution() const
+{
+  if (permutation.empty())
+    return u;
+
+  ScalarField v(u.size());
+  for (std::size_t i = 0; i < permutation.size(); i++)
+    v[i] = u[permutation[i]];
+  return v;
+}
+
+template<class GV, class F>
+void P1Elements<GV, F>::setSolution(const ScalarField& v)
+{
+  if (permutation.empty())
+  {
+    u = v;
+    return;
+  }
+
+  u.resize(v.size());
+  for (std::size_t i = 0; i < permutation.size(); i++)
+    u[permutation[i]] = v[i];
+}
+
+//! interpolate a P1 or Q1 function from level coarseLevel of a grid to the
+//! next finer level, whose vertices are numbered by fineSet
+template<class Grid, class IndexSet, class V>
+void prolongateP1(const Grid& grid, int coarseLevel, const IndexSet& fineSet,
+                  const V& coarse, V& fine)
+{
+  const int dim = Grid::dimension;
+  typedef typename Grid::ctype ctype;
+
+  const P1ShapeFunctionSet<ctype,ctype,dim>& p1basis = P1ShapeFunctionSet<ctype,ctype,dim>::instance();
+  const QkShapeFunctionSet<ctype,ctype,dim,1>& q1basis = QkShapeFunctionSet<ctype,ctype,dim,1>::instance();
+  const auto& coarseSet = grid.levelIndexSet(coarseLevel);
+
+  // the value at a corner of a child is the value of the father's linear
+  // function at the position of the corner in the father
+  fine.resize(fineSet.size(dim));
+  for (const auto& element : elements(grid.levelGridView(coarseLevel+1)))
+  {
+    const auto father = element.father();
+    const auto geometryInFather = element.geometryInFather();
+    for (int k = 0; k < geometryInFather.corners(); k++)
+    {
+      ctype value = 0.0;
+      for (unsigned int m = 0; m < father.subEntities(dim); m++)
+      {
+        const ctype coarseValue = coarse[coarseSet.subIndex(father,m,dim)];
+        const ctype weight = father.type().isCube()
+          ? q1basis[m].evaluateFunction(geometryInFather.corner(k))
+          : p1basis[m].evaluateFunction(geometryInFather.corner(k));
+        value += weight * coarseValue;
+      }
+      fine[fineSet.subIndex(element,k,dim)] = value;
+    }
+  }
+}
+
 // an example right hand side function
 template<class ctype, int dim>
 class Bump {
@@ -266,53 +854,190 @@ public:
   }
 };
 
-int main(int argc, char** argv)
+// discretize and solve the example problem on the leaf grid of grid with
+// the options given in params, and write the solution
+template<class GridType>
+void solvePoisson(GridType& grid, const Dune::ParameterTree& params)
 {
-#if HAVE_ALBERTA && ALBERTA_DIM==2
-  static const int dim = 2;                             /*@\label{fem:dim}@*/
-  std::stringstream gridfile;
-    gridfile << DUNE_GRID_HOWTO_EXAMPLE_GRIDS_PATH
-      << "2dgrid.al";                                   /*@\label{fem:file}@*/
+  const int threads = params.get<int>("threads", 1);
+  const bool matrixFree = params.get<bool>("matrixfree", false);
+  const bool cacheGradients = params.get<bool>("cachegradients", false);
+  // assemble affine simplices in batches with the SIMD kernel
+  const bool batch = params.get<bool>("batch", false);
+#if HAVE_DUNE_ISTL
+  const std::string solverType = params.get<std::string>("solver",
+    matrixFree ? "chebyshev-cg" : "ilu-bicgstab");
+#else
+  const std::string solverType = params.get<std::string>("solver", "jacobi-cg");
+#endif // HAVE_DUNE_ISTL
+  const double reduction = params.get<double>("reduction", 1e-15);
+  // "rcm" for the reverse Cuthill-McKee ordering of the vertices
+  const std::string reorder = params.get<std::string>("reorder", "none");
+  // with "-cascadic l" the problem is solved on grid level l first and
+  // each solution is interpolated to the next finer level as initial guess
+  const int cascadic = params.get<int>("cascadic", -1);
+  // CG needs a symmetric matrix, so eliminate symmetrically by default
+  const bool symmetric = params.get<bool>("symmetric",
+    solverType.size() >= 2 && solverType.compare(solverType.size()-2, 2, "cg") == 0);
 
-  typedef Dune::AlbertaGrid<dim,dim> GridType;
-  typedef GridType::LeafGridView GV;
+  // the geometric multigrid needs the leaf grid view, so it cannot solve
+  // on the coarser levels of the nested iteration
+  if (cascadic >= 0 && cascadic < grid.maxLevel() && solverType.compare(0, 4, "gmg-") == 0)
+    DUNE_THROW(Dune::NotImplemented, "-solver " << solverType << " cannot be combined with -cascadic "
+               << cascadic << ", geometric multigrid only works on the leaf grid");
 
-  typedef GridType::ctype ctype;
+  static const int dim = GridType::dimension;
+  typedef typename GridType::LeafGridView GV;
+  typedef typename GridType::ctype ctype;
   typedef Bump<ctype,dim> Func;
 
-  GridType grid(gridfile.str());
-  const GV& gv = grid.leafGridView();
+  const GV gv = grid.leafGridView();
 
   Func f;
   P1Elements<GV,Func> p1(gv, f);
-
-#if HAVE_DUNE_ISTL
-  grid.globalRefine(16);
-#else
-  grid.globalRefine(10);
-#endif // HAVE_DUNE_ISTL
+  p1.symmetricDirichlet = symmetric;
+  p1.matrixFree = matrixFree;
+  p1.cacheGradients = cacheGradients;
+  p1.batchAssembly = batch;
 
   std::cout << "-----------------------------------" << "\n";
   std::cout << "number of unknowns: " << grid.size(dim) << "\n";
 
-  std::cout << "determine adjacency pattern..." << "\n";
-  p1.determineAdjacencyPattern();
+  if (!matrixFree)
+  {
+    std::cout << "determine adjacency pattern..." << "\n";
+    p1.determineAdjacencyPattern();
+    std::cout << "matrix bandwidth: " << p1.adjacencyPattern.bandwidth() << "\n";
 
-  std::cout << "assembling..." << "\n";
-  p1.assemble();
+    if (reorder == "rcm")
+    {
+      std::cout << "reordering vertices..." << "\n";
+      p1.reorderVertices();
+      std::cout << "matrix bandwidth: " << p1.adjacencyPattern.bandwidth() << "\n";
+    }
+    else if (reorder != "none")
+      DUNE_THROW(Dune::Exception, "unknown vertex ordering " << reorder);
+  }
 
-#if HAVE_DUNE_ISTL
-  std::cout << "solving..." << "\n";
-  p1.solve();
+  std::cout << "assembling with " << threads << " thread(s)..." << "\n";
+  Dune::Timer timer;
+  p1.assemble(threads);
+  std::cout << "assembly time: " << timer.elapsed() << "s" << "\n";
+
+  // nested iteration: solve on the coarser levels, starting each solve
+  // with the interpolated solution of the level below
+  const bool nested = cascadic >= 0 && cascadic < grid.maxLevel();
+  double coarseSolverTime = 0.0;
+  if (nested)
+  {
+    typedef typename GridType::LevelGridView LevelGV;
+
+    std::cout << "nested iteration from level " << cascadic << "..." << "\n";
+    typename P1Elements<GV,Func>::ScalarField guess;
+    for (int level = cascadic; level < grid.maxLevel(); level++)
+    {
+      const LevelGV lgv = grid.levelGridView(level);
+      P1Elements<LevelGV,Func> p1level(lgv, f);
+      p1level.symmetricDirichlet = symmetric;
+      p1level.matrixFree = matrixFree;
+      p1level.cacheGradients = cacheGradients;
+      p1level.batchAssembly = batch;
+      if (!matrixFree)
+      {
+        p1level.determineAdjacencyPattern();
+        if (reorder == "rcm")
+          p1level.reorderVertices();
+      }
+      p1level.assemble(threads);
+
+      if (level > cascadic)
+        p1level.setSolution(guess);
+      auto levelStats = p1level.solve(solverType, reduction, level > cascadic);
+      coarseSolverTime += levelStats.setupTime + levelStats.solveTime;
+      std::cout << "level " << level << ": " << lgv.size(dim) << " unknowns, "
+                << levelStats.iterations << " iterations" << "\n";
+
+      // the next finer level of the finest coarse level is the leaf grid
+      if (level+1 < grid.maxLevel())
+        prolongateP1(grid, level, grid.levelIndexSet(level+1), p1level.solution(), guess);
+      else
+        prolongateP1(grid, level, grid.leafIndexSet(), p1level.solution(), guess);
+    }
+    p1.setSolution(guess);
+  }
+
+  std::cout << "solving with " << solverType << "..." << "\n";
+  auto stats = p1.solve(solverType, reduction, nested);
+  std::cout << "iterations: " << stats.iterations
+            << (stats.converged ? "" : " (not converged)")
+            << ", reduction: " << stats.reduction << "\n";
+  std::cout << "setup time: " << stats.setupTime << "s"
+            << ", solve time: " << stats.solveTime << "s" << "\n";
+  if (nested)
+    std::cout << "solver time on the coarser levels: " << coarseSolverTime << "s" << "\n";
+  std::cout << (matrixFree ? "matrix-free operator: " : "assembled matrix: ")
+            << stats.operatorBytes << " bytes" << "\n";
 
   std::cout << "visualizing..." << "\n";
-  Dune::VTKWriter<GridType::LeafGridView> vtkwriter(grid.leafGridView());
-  vtkwriter.addVertexData(p1.u, "u");
+  Dune::VTKWriter<GV> vtkwriter(gv);
+  const auto u = p1.solution();
+  vtkwriter.addVertexData(u, "u");
   vtkwriter.write("fem2d", Dune::VTK::appendedraw);
+}
+
+int main(int argc, char** argv)
+{
+  // start try/catch block to get error messages from dune
+  try {
+    // read options like "-threads 4" from the command line
+    Dune::ParameterTree params;
+    Dune::ParameterTreeParser::readOptions(argc, argv, params);
+
+    // "simplex" for P1 elements on an Alberta grid, "cube" for Q1 elements
+    // on a YaspGrid
+#if HAVE_ALBERTA && ALBERTA_DIM==2
+    const std::string gridType = params.get<std::string>("grid", "simplex");
 #else
-  std::cout << "for solving and visualizing dune-istl is necessary." << "\n";
-#endif // HAVE_DUNE_ISTL
+    const std::string gridType = params.get<std::string>("grid", "cube");
+#endif // HAVE_ALBERTA && ALBERTA_DIM==2
+
+    static const int dim = 2;                           /*@\label{fem:dim}@*/
+
+    if (gridType == "simplex")
+    {
+#if HAVE_ALBERTA && ALBERTA_DIM==2
+      std::stringstream gridfile;
+      gridfile << DUNE_GRID_HOWTO_EXAMPLE_GRIDS_PATH
+        << "2dgrid.al";                                 /*@\label{fem:file}@*/
+
+      typedef Dune::AlbertaGrid<dim,dim> GridType;
+      GridType grid(gridfile.str());
+      grid.globalRefine(16);
+      solvePoisson(grid, params);
 #else
-  std::cerr << "You need Alberta in 2d for this program." << std::endl;
+      std::cerr << "You need Alberta in 2d for this program." << std::endl;
 #endif // HAVE_ALBERTA && ALBERTA_DIM==2
+    }
+    else if (gridType == "cube")
+    {
+      // the unit square with cells x cells elements, refined uniformly
+      const int cells = params.get<int>("cells", 16);
+      Dune::FieldVector<double,dim> length(1.0);
+      std::array<int,dim> elements;
+      elements.fill(cells);
+      Dune::YaspGrid<dim> grid(length, elements);
+      grid.globalRefine(params.get<int>("refine", 4));
+      solvePoisson(grid, params);
+    }
+    else
+      std::cerr << "unknown grid type " << gridType << std::endl;
+  }
+  catch (std::exception & e) {
+    std::cout << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+  catch (...) {
+    std::cout << "Unknown ERROR" << std::endl;
+    return 1;
+  }
 }
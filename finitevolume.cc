@@ -6,8 +6,10 @@
 #include <vector>                 // STL vector class
 #include <dune/grid/common/mcmgmapper.hh> // mapper class
 #include <dune/common/parallel/mpihelper.hh> // include mpi helper class
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
 
-#include "vtkout.hh"
+#include "asyncvtkout.hh"
 #include "transportproblem2.hh"
 #include "initialize.hh"
 #include "evolve.hh"
@@ -17,7 +19,7 @@
 //===============================================================
 
 template<class G>
-void timeloop (const G& grid, double tend)
+void timeloop (const G& grid, double tend, VTKOutputFormat format, bool async)
 {
   // make a mapper for codim 0 entities in the leaf grid
   Dune::LeafMultipleCodimMultipleGeomTypeMapper<G>
@@ -26,9 +28,12 @@ void timeloop (const G& grid, double tend)
   // allocate a vector for the concentration
   std::vector<double> c(mapper.size());
 
+  // the snapshots, the grid does not change after the first one
+  VTKSnapshotWriter writer("concentration",format,async);
+
   // initialize concentration with initial values
   initialize(grid,mapper,c);                           /*@\label{fvc:init}@*/
-  vtkout(grid,c,"concentration",0,0.0);
+  writer.write(grid,c,0,0.0);
 
   // now do the time steps
   double t=0,dt;
@@ -52,7 +57,7 @@ void timeloop (const G& grid, double tend)
     if (t >= saveStep)
     {
       // write data
-      vtkout(grid,c,"concentration",counter,t);     /*@\label{fvc:file}@*/
+      writer.write(grid,c,counter,t,false);     /*@\label{fvc:file}@*/
 
       // increase counter and saveStep for next interval
       saveStep += saveInterval;
@@ -63,6 +68,9 @@ void timeloop (const G& grid, double tend)
     std::cout << "s=" << grid.size(0)
               << " k=" << k << " t=" << t << " dt=" << dt << std::endl;
   }                                                    /*@\label{fvc:loop1}@*/
+
+  // wait for the snapshots written in the background
+  writer.flush();
 }
 
 //===============================================================
@@ -78,6 +86,13 @@ int main (int argc , char ** argv)
   try {
     using namespace Dune;
 
+    // read the format of the VTK output, e.g. "-vtk zlib", and whether
+    // it is written in the background, "-async 1", from the command line
+    ParameterTree params;
+    ParameterTreeParser::readOptions(argc, argv, params);
+    const VTKOutputFormat format = vtkOutputFormat(params.get<std::string>("vtk", "binary"));
+    const bool async = params.get<bool>("async", false);
+
     // the GridSelector :: GridType is defined in gridtype.hh and is
     // set during compilation
     typedef GridSelector :: GridType Grid;
@@ -100,7 +115,7 @@ int main (int argc , char ** argv)
     grid.globalRefine(level);
 
     // do time loop until end time 0.5
-    timeloop(grid, 0.5);
+    timeloop(grid, 0.5, format, async);
   }
   catch (std::exception & e) {
     std::cout << "ERROR: " << e.what() << std::endl;
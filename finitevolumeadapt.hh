@@ -4,8 +4,11 @@
 #define __DUNE_GRID_HOWTO_FINITEVOLUMEADAPT_HH__
 
 #include <cmath>
+#include <dune/common/timer.hh>
 #include <dune/grid/utility/persistentcontainer.hh>
 
+#include "adaptstatistics.hh"
+
 struct RestrictedValue
 {
   double value;
@@ -18,8 +21,15 @@ struct RestrictedValue
 };
 
 template<class G, class M, class V>
-bool finitevolumeadapt (G& grid, M& mapper, V& c, int lmin, int lmax, int k)
+bool finitevolumeadapt (G& grid, M& mapper, V& c, int lmin, int lmax, int k,
+                        AdaptStatistics* stats=nullptr)
 {
+  // memory and time accounting, discarded if no statistics are requested
+  AdaptStatistics localstats;
+  AdaptStatistics& s = stats ? *stats : localstats;
+  s.clear();
+  Dune::Timer timer;
+
   // tol value for refinement strategy
   const double refinetol  = 0.05;
   const double coarsentol = 0.001;
@@ -107,12 +117,23 @@ bool finitevolumeadapt (G& grid, M& mapper, V& c, int lmin, int lmax, int k)
       ++marked;
     }
   }                                              /*@\label{fah:loop3}@*/
+  s.marked = marked;
+  s.indicatorBytes = indicator.capacity()*sizeof(typename V::value_type);
+  s.markTime = timer.elapsed();
   if( marked==0 )
+  {
+    s.countElements(grid);
+    s.dataBytes = c.capacity()*sizeof(typename V::value_type);
+    s.peakRSS = AdaptStatistics::currentPeakRSS();
     return false;
+  }
 
+  timer.reset();
   grid.preAdapt();
+  s.preAdaptTime = timer.elapsed();
 
   typedef Dune::PersistentContainer<G,RestrictedValue> RestrictionMap;
+  timer.reset();
   RestrictionMap restrictionmap(grid,0); // restricted concentration /*@\label{fah:loop4}@*/
 
   for (int level=grid.maxLevel(); level>=0; level--)
@@ -141,14 +162,20 @@ bool finitevolumeadapt (G& grid, M& mapper, V& c, int lmin, int lmax, int k)
       }
     }                                                  /*@\label{fah:loop5}@*/
   }
+  s.restrictTime = timer.elapsed();
 
   // adapt mesh and mapper
+  timer.reset();
   bool rv=grid.adapt();                                /*@\label{fah:adapt}@*/
+  s.adaptTime = timer.elapsed();
+  timer.reset();
   mapper.update();                                     /*@\label{fah:update}@*/
   restrictionmap.resize();
   c.resize(mapper.size());                             /*@\label{fah:resize}@*/
+  s.updateTime = timer.elapsed();
 
   // interpolate new cells, restrict coarsened cells
+  timer.reset();
   for (int level=0; level<=grid.maxLevel(); level++)   /*@\label{fah:loop6}@*/
   {
     LevelGridView levelView = grid.levelGridView(level);
@@ -188,7 +215,19 @@ bool finitevolumeadapt (G& grid, M& mapper, V& c, int lmin, int lmax, int k)
       }
     }                                                  /*@\label{fah:loop7}@*/
   }
+  s.prolongTime = timer.elapsed();
+
+  // record memory held by the containers before it is released
+  s.restrictionBytes = persistentContainerBytes<G,RestrictedValue>(restrictionmap.size());
+  s.dataBytes = c.capacity()*sizeof(typename V::value_type);
+
+  timer.reset();
   grid.postAdapt();
+  s.postAdaptTime = timer.elapsed();
+
+  s.adapted = true;
+  s.countElements(grid);
+  s.peakRSS = AdaptStatistics::currentPeakRSS();
 
   return rv;
 }
@@ -0,0 +1,108 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_FIXEDQUADRATURE_HH__
+#define __DUNE_GRID_HOWTO_FIXEDQUADRATURE_HH__
+
+#include <array>
+
+#include <dune/common/fvector.hh>
+
+// FixedSimplexRule:
+// quadrature rules on the reference simplex with a number of points
+// known at compile time, for loops over the points that the compiler can
+// unroll and without the lookup in Dune::QuadratureRules. Order is the
+// order the rule is exact for, available is false if there is no table.
+template<class ctype, int dim, int order>
+struct FixedSimplexRule
+{
+  static constexpr bool available = false;
+};
+
+// the table of the smallest order of at least p
+template<class ctype, int dim, int p>
+using FixedSimplexRuleOfOrder = FixedSimplexRule<ctype,dim,(p < 1) ? 1 : p>;
+
+// triangle, the centroid
+template<class ctype>
+struct FixedSimplexRule<ctype,2,1>
+{
+  static constexpr bool available = true;
+  static constexpr int size = 1;
+  static constexpr std::array<std::array<ctype,2>,size> points = {{ {{1.0/3.0, 1.0/3.0}} }};
+  static constexpr std::array<ctype,size> weights = {{ 0.5 }};
+};
+
+// triangle, Strang and Fix, 3 interior points
+template<class ctype>
+struct FixedSimplexRule<ctype,2,2>
+{
+  static constexpr bool available = true;
+  static constexpr int size = 3;
+  static constexpr std::array<std::array<ctype,2>,size> points = {{
+    {{1.0/6.0, 1.0/6.0}}, {{2.0/3.0, 1.0/6.0}}, {{1.0/6.0, 2.0/3.0}} }};
+  static constexpr std::array<ctype,size> weights = {{ 1.0/6.0, 1.0/6.0, 1.0/6.0 }};
+};
+
+// triangle, Strang and Fix, the 6 permutations of one point with
+// positive weights
+template<class ctype>
+struct FixedSimplexRule<ctype,2,3>
+{
+  static constexpr bool available = true;
+  static constexpr int size = 6;
+  static constexpr ctype a = 0.659027622374092;
+  static constexpr ctype b = 0.231933368553031;
+  static constexpr ctype c = 0.109039009072877;
+  static constexpr std::array<std::array<ctype,2>,size> points = {{
+    {{a, b}}, {{b, a}}, {{a, c}}, {{c, a}}, {{b, c}}, {{c, b}} }};
+  static constexpr std::array<ctype,size> weights = {{
+    1.0/12.0, 1.0/12.0, 1.0/12.0, 1.0/12.0, 1.0/12.0, 1.0/12.0 }};
+};
+
+// tetrahedron, the centroid
+template<class ctype>
+struct FixedSimplexRule<ctype,3,1>
+{
+  static constexpr bool available = true;
+  static constexpr int size = 1;
+  static constexpr std::array<std::array<ctype,3>,size> points = {{ {{0.25, 0.25, 0.25}} }};
+  static constexpr std::array<ctype,size> weights = {{ 1.0/6.0 }};
+};
+
+// tetrahedron, 4 points on the lines from the centroid to the corners
+template<class ctype>
+struct FixedSimplexRule<ctype,3,2>
+{
+  static constexpr bool available = true;
+  static constexpr int size = 4;
+  static constexpr ctype a = 0.5854101966249685;
+  static constexpr ctype b = 0.1381966011250105;
+  static constexpr std::array<std::array<ctype,3>,size> points = {{
+    {{b, b, b}}, {{a, b, b}}, {{b, a, b}}, {{b, b, a}} }};
+  static constexpr std::array<ctype,size> weights = {{ 1.0/24.0, 1.0/24.0, 1.0/24.0, 1.0/24.0 }};
+};
+
+// tetrahedron, Keast, the centroid and 4 points
+template<class ctype>
+struct FixedSimplexRule<ctype,3,3>
+{
+  static constexpr bool available = true;
+  static constexpr int size = 5;
+  static constexpr ctype a = 0.5;
+  static constexpr ctype b = 1.0/6.0;
+  static constexpr std::array<std::array<ctype,3>,size> points = {{
+    {{0.25, 0.25, 0.25}}, {{b, b, b}}, {{a, b, b}}, {{b, a, b}}, {{b, b, a}} }};
+  static constexpr std::array<ctype,size> weights = {{ -2.0/15.0, 3.0/40.0, 3.0/40.0, 3.0/40.0, 3.0/40.0 }};
+};
+
+//! the point q of a fixed rule as a field vector
+template<class Rule, class ctype, int dim>
+Dune::FieldVector<ctype,dim> fixedRulePoint (int q)
+{
+  Dune::FieldVector<ctype,dim> x;
+  for (int d = 0; d < dim; d++)
+    x[d] = Rule::points[q][d];
+  return x;
+}
+
+#endif // __DUNE_GRID_HOWTO_FIXEDQUADRATURE_HH__
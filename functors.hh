@@ -3,6 +3,9 @@
 #ifndef __DUNE_GRID_HOWTO_FUNCTORS_HH__
 #define __DUNE_GRID_HOWTO_FUNCTORS_HH__
 
+#include <cmath>
+#include <cstddef>
+
 #include <dune/common/fvector.hh>
 // a smooth function
 template<typename ct, int dim>
@@ -15,6 +18,19 @@ public:
     y -= midpoint;
     return exp(-3.234*(y*y));
   }
+  // evaluate at n points at once, see integrateEntity()
+  void evaluate (std::size_t n, const Dune::FieldVector<ct,dim>* x, double* values) const
+  {
+    for (std::size_t i = 0; i < n; i++)
+    {
+      ct r2 = 0.0;
+      for (int d = 0; d < dim; d++)
+        r2 += (x[i][d]-midpoint[d])*(x[i][d]-midpoint[d]);
+      values[i] = -3.234*r2;
+    }
+    for (std::size_t i = 0; i < n; i++)
+      values[i] = std::exp(values[i]);
+  }
 private:
   Dune::FieldVector<ct,dim> midpoint;
 };
@@ -34,6 +50,17 @@ public:
     y -= midpoint;
     return 1.0/(1E-4+y*y);
   }
+  // evaluate at n points at once, see integrateEntity()
+  void evaluate (std::size_t n, const Dune::FieldVector<ct,dim>* x, double* values) const
+  {
+    for (std::size_t i = 0; i < n; i++)
+    {
+      ct r2 = 0.0;
+      for (int d = 0; d < dim; d++)
+        r2 += (x[i][d]-midpoint[d])*(x[i][d]-midpoint[d]);
+      values[i] = 1.0/(1E-4+r2);
+    }
+  }
 private:
   Dune::FieldVector<ct,dim> midpoint;
 };
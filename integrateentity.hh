@@ -3,9 +3,21 @@
 #ifndef DUNE_INTEGRATE_ENTITY_HH
 #define DUNE_INTEGRATE_ENTITY_HH
 
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include <dune/common/exceptions.hh>
+#include <dune/common/fvector.hh>
 #include <dune/geometry/quadraturerules.hh>
 
+#include "affinegeometry.hh"
+#include "embeddedquadrature.hh"
+#include "fixedquadrature.hh"
+
 //! compute integral of function over entity with given order
 template<class Entity, class Function>
 double integrateEntity (const Entity &entity, const Function &f, int p)
@@ -45,4 +57,201 @@ double integrateEntity (const Entity &entity, const Function &f, int p)
   return result;
 }
 
+//! scratch space for the batched integrateEntity(), reused over entities
+template<class ctype, int dimworld>
+struct QuadratureBuffer
+{
+  std::vector<Dune::FieldVector<ctype,dimworld> > points;   // global coordinates
+  std::vector<double> factors;                             // weight * integration element
+  std::vector<double> values;                              // function values
+};
+
+//! true if f provides evaluate(n,x,values) computing values[i] = f(x[i])
+template<class Function, class Point, class = void>
+struct HasBatchEvaluate : std::false_type {};
+
+template<class Function, class Point>
+struct HasBatchEvaluate<Function, Point,
+                        std::void_t<decltype(std::declval<const Function&>()
+                                             .evaluate(std::size_t(), std::declval<const Point*>(),
+                                                       std::declval<double*>()))> >
+  : std::true_type {};
+
+//! map the points of rule to global coordinates of geometry, evaluate f
+//! there and store the values and the products of weight and
+//! integration element in buffer
+template<class Geometry, class Function, class ctype, int dim, int dimworld>
+void evaluateQuadraturePoints (const Geometry& geometry, const Function& f,
+                               const Dune::QuadratureRule<ctype,dim>& rule,
+                               QuadratureBuffer<ctype,dimworld>& buffer)
+{
+  typedef typename Geometry::GlobalCoordinate GlobalCoordinate;
+
+  // map all points to global coordinates, on affine geometries with one
+  // Jacobian for all points instead of a call of global() per point
+  const std::size_t n = rule.size();
+  buffer.points.resize(n);
+  buffer.factors.resize(n);
+  buffer.values.resize(n);
+  AffineGeometryCache<ctype,dim,dimworld> affine;
+  if (affine.bind(geometry))
+  {
+    affine.global(rule, buffer.points.data());
+    const double detjac = affine.integrationElement();
+    for (std::size_t i = 0; i < n; i++)
+      buffer.factors[i] = rule[i].weight() * detjac;
+  }
+  else
+  {
+    for (std::size_t i = 0; i < n; i++)
+    {
+      buffer.points[i] = geometry.global(rule[i].position());
+      buffer.factors[i] = rule[i].weight() * geometry.integrationElement(rule[i].position());
+    }
+  }
+
+  // evaluate the function at all points
+  if constexpr (HasBatchEvaluate<Function,GlobalCoordinate>::value)
+    f.evaluate(n, buffer.points.data(), buffer.values.data());
+  else
+    for (std::size_t i = 0; i < n; i++)
+      buffer.values[i] = f(buffer.points[i]);
+}
+
+//! sum of values[i]*factors[i] with four independent partial sums, which
+//! the compiler can keep in one SIMD register
+template<class ctype, int dimworld>
+double weightedSum (const QuadratureBuffer<ctype,dimworld>& buffer)
+{
+  const std::size_t n = buffer.values.size();
+  double sum[4] = {0.0, 0.0, 0.0, 0.0};
+  std::size_t i = 0;
+  for (; i+4 <= n; i += 4)
+    for (int l = 0; l < 4; l++)
+      sum[l] += buffer.values[i+l] * buffer.factors[i+l];
+  for (; i < n; i++)
+    sum[0] += buffer.values[i] * buffer.factors[i];
+  return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+//! compute integral of function over entity with given order with the
+//! rule from Dune::QuadratureRules, all quadrature points are mapped and
+//! evaluated at once using buffer
+template<class Entity, class Function, class ctype, int dimworld>
+double integrateEntityRuntime (const Entity &entity, const Function &f, int p,
+                               QuadratureBuffer<ctype,dimworld>& buffer)
+{
+  const int dim = Entity::dimension;
+
+  const typename Entity::Geometry geometry = entity.geometry();
+  const Dune::QuadratureRule<ctype,dim>&
+  rule = Dune::QuadratureRules<ctype,dim>::rule(geometry.type(),p);
+  if (rule.order()<p)
+    DUNE_THROW(Dune::Exception,"order not available");
+
+  evaluateQuadraturePoints(geometry, f, rule, buffer);
+  return weightedSum(buffer);
+}
+
+//! compute integral of function over entity with the order p known at
+//! compile time. Affine simplices use a FixedSimplexRule whose loops the
+//! compiler can unroll, other entities the rule from
+//! Dune::QuadratureRules.
+template<int p, class Entity, class Function, class ctype, int dimworld>
+double integrateEntity (const Entity &entity, const Function &f,
+                        QuadratureBuffer<ctype,dimworld>& buffer)
+{
+  const int dim = Entity::dimension;
+  typedef FixedSimplexRuleOfOrder<ctype,dim,p> Rule;
+  if constexpr (Rule::available)
+  {
+    typedef AffineGeometryCache<ctype,dim,dimworld> Affine;
+    const typename Entity::Geometry geometry = entity.geometry();
+    Affine affine;
+    if (geometry.type().isSimplex() && affine.bind(geometry))
+    {
+      std::array<typename Affine::GlobalCoordinate,Rule::size> x;
+      std::array<double,Rule::size> values;
+      for (int q = 0; q < Rule::size; q++)
+        x[q] = affine.global(fixedRulePoint<Rule,ctype,dim>(q));
+      if constexpr (HasBatchEvaluate<Function,typename Affine::GlobalCoordinate>::value)
+        f.evaluate(Rule::size, x.data(), values.data());
+      else
+        for (int q = 0; q < Rule::size; q++)
+          values[q] = f(x[q]);
+      double result = 0.0;
+      for (int q = 0; q < Rule::size; q++)
+        result += Rule::weights[q] * values[q];
+      return result * affine.integrationElement();
+    }
+  }
+  return integrateEntityRuntime(entity, f, p, buffer);
+}
+
+//! compute integral of function over entity with given order, using the
+//! rules fixed at compile time for the orders up to 3
+template<class Entity, class Function, class ctype, int dimworld>
+double integrateEntity (const Entity &entity, const Function &f, int p,
+                        QuadratureBuffer<ctype,dimworld>& buffer)
+{
+  switch (p)
+  {
+  case 0 :
+  case 1 : return integrateEntity<1>(entity, f, buffer);
+  case 2 : return integrateEntity<2>(entity, f, buffer);
+  case 3 : return integrateEntity<3>(entity, f, buffer);
+  default : return integrateEntityRuntime(entity, f, p, buffer);
+  }
+}
+
+//! integral and error estimate of one entity
+struct EmbeddedIntegral
+{
+  double value;   // integral with the rule of order 3
+  double error;   // difference to the rule of order 1
+};
+
+//! integral and error estimate of one entity as kept over the steps of
+//! adaptive integration, valid is false until they are computed
+struct ElementIntegrals
+{
+  double value;
+  double error;
+  bool valid;
+
+  ElementIntegrals () : value(0.0), error(0.0), valid(false) {}
+};
+
+//! compute the integral of function over entity with order 3 and estimate
+//! its error by the difference to order 1, with an embedded rule the
+//! function is evaluated only once at the points of the order 3 rule
+template<class Entity, class Function, class ctype, int dimworld>
+EmbeddedIntegral integrateEntityEmbedded (const Entity &entity, const Function &f,
+                                          QuadratureBuffer<ctype,dimworld>& buffer)
+{
+  const int dim = Entity::dimension;
+  typedef EmbeddedQuadratureRule<ctype,dim> Rule;
+
+  const typename Entity::Geometry geometry = entity.geometry();
+  const Rule* rule = EmbeddedQuadratureRules<ctype,dim>::rule(geometry.type());
+
+  EmbeddedIntegral result;
+  if (!rule)
+  {
+    // no embedded rule for this type, use two independent rules
+    const double low = integrateEntity(entity, f, Rule::lowOrder, buffer);
+    result.value = integrateEntity(entity, f, Rule::highOrder, buffer);
+    result.error = std::abs(result.value - low);
+    return result;
+  }
+
+  evaluateQuadraturePoints(geometry, f, *rule, buffer);
+  result.value = weightedSum(buffer);
+  double low = 0.0;
+  for (std::size_t i = 0; i < rule->size(); i++)
+    low += rule->lowFactor(i) * buffer.factors[i] * buffer.values[i];
+  result.error = std::abs(result.value - low);
+  return result;
+}
+
 #endif
@@ -5,15 +5,18 @@
 #include <config.h>             // file generated by CMake
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <dune/grid/yaspgrid.hh> // load yaspgrid definition
 #include <dune/common/parallel/mpihelper.hh> // include mpi helper class
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
 
 #include "functors.hh"
-#include "integrateentity.hh"
+#include "parallelintegration.hh"
 
-//! uniform refinement test
+//! uniform refinement test, integrating with the given number of threads
 template<class Grid>
-void uniformintegration (Grid& grid)
+void uniformintegration (Grid& grid, int threads)
 {
   // function to integrate
   Exp<typename Grid::ctype,Grid::dimension> f;
@@ -24,28 +27,28 @@ void uniformintegration (Grid& grid)
   // get GridView instance
   GridView gridView = grid.leafGridView();
 
-  // get iterator type
-  typedef typename GridView :: template Codim<0> :: Iterator LeafIterator;
-
   // loop over grid sequence
   double oldvalue=1E100;
   for (int k=0; k<10; k++)
   {
-    // compute integral with some order
-    double value = 0.0;
-    LeafIterator eendit = gridView.template end<0>();
-    for (LeafIterator it = gridView.template begin<0>(); it!=eendit; ++it)
-      value += integrateEntity(*it,f,1);                /*@\label{ic:call}@*/
+    // compute integral with some order, summing over all elements of
+    // all processes
+    double value = integrateGridView(gridView,f,1,threads);      /*@\label{ic:call}@*/
+
+    // number of elements of all processes
+    auto interior = elements(gridView, Dune::Partitions::interior);
+    const int size = gridView.comm().sum(int(std::distance(interior.begin(), interior.end())));
 
     // print result and error estimate
-    std::cout << "elements="
-              << std::setw(8) << std::right
-              << grid.size(0)
-              << " integral="
-              << std::scientific << std::setprecision(12)
-              << value
-              << " error=" << std::abs(value-oldvalue)
-              << std::endl;
+    if (gridView.comm().rank() == 0)
+      std::cout << "elements="
+                << std::setw(8) << std::right
+                << size
+                << " integral="
+                << std::scientific << std::setprecision(12)
+                << value
+                << " error=" << std::abs(value-oldvalue)
+                << std::endl;
 
     // save value of integral
     oldvalue=value;
@@ -64,6 +67,11 @@ int main(int argc, char **argv)
   try {
     using namespace Dune;
 
+    // read options like "-threads 4" from the command line
+    ParameterTree params;
+    ParameterTreeParser::readOptions(argc, argv, params);
+    const int threads = params.get<int>("threads", 1);
+
     // the GridSelector :: GridType is defined in gridtype.hh and is
     // set during compilation
     typedef GridSelector :: GridType Grid;
@@ -77,7 +85,8 @@ int main(int argc, char **argv)
     GridPtr<Grid> gridPtr( dgfFileName.str() );
 
     // integrate and compute error with extrapolation
-    uniformintegration( *gridPtr );
+    gridPtr.loadBalance();
+    uniformintegration( *gridPtr, threads );
   }
   catch (std::exception & e) {
     std::cout << "ERROR: " << e.what() << std::endl;
@@ -0,0 +1,421 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+
+#include <config.h>
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <dune/common/parallel/mpihelper.hh> // include mpi helper class
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
+#include <dune/common/timer.hh>
+#include <dune/geometry/quadraturerules.hh>
+#include <dune/grid/utility/persistentcontainer.hh>
+#if HAVE_UG
+#include <dune/grid/uggrid.hh>
+#endif
+
+#include "unitcube.hh"
+#include "functors.hh"
+#include "integrateentity.hh"
+#include "parallelintegration.hh"
+#include "bulkmarking.hh"
+
+// CountingFunction:
+// wraps a functor and counts the points it is evaluated at, both single
+// evaluations and those of evaluate() are counted
+template<class Function>
+class CountingFunction
+{
+public:
+  CountingFunction (const Function& f) : f_(f), count_(0) {}
+
+  template<class Point>
+  double operator() (const Point& x) const
+  {
+    count_ += 1;
+    return f_(x);
+  }
+
+  template<class Point>
+  void evaluate (std::size_t n, const Point* x, double* values) const
+  {
+    count_ += n;
+    if constexpr (HasBatchEvaluate<Function,Point>::value)
+      f_.evaluate(n, x, values);
+    else
+      for (std::size_t i = 0; i < n; i++)
+        values[i] = f_(x[i]);
+  }
+
+  long count () const
+  {
+    return count_;
+  }
+
+private:
+  const Function& f_;
+  mutable long count_;
+};
+
+//! exact integral of Exp over the unit square, the product of two
+//! integrals in one variable
+inline double expIntegral ()
+{
+  const double c = 3.234;
+  const double line = std::sqrt(std::acos(-1.0)/c)*std::erf(0.5*std::sqrt(c));
+  return line*line;
+}
+
+//! integral of Needle over the unit square. The integral over x is
+//! 2/a atan(1/(2a)) with a^2 = 1E-4+(y-1)^2, the one over y is computed
+//! with a Gauss rule on intervals shrinking geometrically towards the
+//! peak at y=1.
+inline double needleIntegral ()
+{
+  const Dune::QuadratureRule<double,1>& rule
+    = Dune::QuadratureRules<double,1>::rule(Dune::GeometryTypes::line, 39);
+  const int intervals = 60;
+  double sum = 0.0;
+  for (int k = 0; k < intervals; k++)
+  {
+    const double lower = 1.0 - std::ldexp(1.0,-k);
+    const double upper = (k == intervals-1) ? 1.0 : 1.0 - std::ldexp(1.0,-k-1);
+    for (const auto& qp : rule)
+    {
+      const double y = lower + (upper-lower)*qp.position()[0];
+      const double a = std::sqrt(1E-4 + (y-1.0)*(y-1.0));
+      sum += qp.weight()*(upper-lower)*2.0/a*std::atan(0.5/a);
+    }
+  }
+  return sum;
+}
+
+// BenchmarkParameters:
+// the options of the benchmark, read from the command line
+struct BenchmarkParameters
+{
+  int order;          // quadrature order of the uniform runs
+  double tol;         // relative error at which a run stops
+  long maxElements;   // a run stops at this number of elements
+  double theta;       // fraction of the error refined by bulk marking
+};
+
+// BenchmarkTable:
+// collects the results of all runs, one line per refinement step, and
+// writes them as comma separated values. All processes take part in the
+// runs, but only the one with write set opens and writes the file.
+class BenchmarkTable
+{
+public:
+  BenchmarkTable (const std::string& fileName, bool write)
+    : write_(write)
+  {
+    if (!write_)
+      return;
+    file_.open(fileName);
+    if (!file_)
+      DUNE_THROW(Dune::IOError, "could not open " << fileName);
+    file_ << "grid,function,strategy,step,elements,evaluations,seconds,integral,error"
+          << std::endl;
+    file_ << std::scientific << std::setprecision(12);
+  }
+
+  void add (const std::string& grid, const std::string& function,
+            const std::string& strategy, int step, long elements,
+            long evaluations, double seconds, double value, double error)
+  {
+    if (!write_)
+      return;
+    file_ << grid << "," << function << "," << strategy << "," << step
+          << "," << elements << "," << evaluations << "," << seconds
+          << "," << value << "," << error << std::endl;
+  }
+
+  // true on the process writing the file
+  bool writing () const
+  {
+    return write_;
+  }
+
+private:
+  bool write_;
+  std::ofstream file_;
+};
+
+// BenchmarkGrid:
+// the unit square of the runs as created by UnitCube
+template<class Grid, int variant>
+class BenchmarkGrid
+{
+public:
+  Grid& grid ()
+  {
+    return uc_.grid();
+  }
+
+private:
+  UnitCube<Grid,variant> uc_;
+};
+
+// YaspGrid distributes its elements among the processes of its
+// communicator, which is not possible for the single element of the
+// coarse grid, so every process creates its own grid
+template<int dim, int variant>
+class BenchmarkGrid<Dune::YaspGrid<dim>,variant>
+{
+public:
+  BenchmarkGrid ()
+    : grid_(Dune::FieldVector<double,dim>(1.0), filledArray(1), std::bitset<dim>(), 1,
+            Dune::MPIHelper::getLocalCommunicator())
+  {}
+
+  Dune::YaspGrid<dim>& grid ()
+  {
+    return grid_;
+  }
+
+private:
+  static std::array<int,dim> filledArray (int n)
+  {
+    std::array<int,dim> a;
+    a.fill(n);
+    return a;
+  }
+
+  Dune::YaspGrid<dim> grid_;
+};
+
+//! the errors of all processes in the order of their ranks
+template<class Communication>
+std::vector<double> gatherErrors (const Communication& comm, const std::vector<double>& errors)
+{
+  int size = errors.size();
+  std::vector<int> sizes(comm.size());
+  comm.allgather(&size, 1, sizes.data());
+  std::vector<int> offsets(comm.size(), 0);
+  for (int p = 1; p < comm.size(); p++)
+    offsets[p] = offsets[p-1] + sizes[p-1];
+  std::vector<double> all(offsets.back() + sizes.back());
+  comm.allgatherv(errors.data(), size, all.data(), sizes.data(), offsets.data());
+  return all;
+}
+
+//! number of interior elements of all processes
+template<class GridView>
+long interiorElements (const GridView& gridView)
+{
+  const auto range = elements(gridView, Dune::Partitions::interior);
+  const long count = std::distance(range.begin(), range.end());
+  return gridView.comm().sum(count);
+}
+
+//! integrate with the given order on a sequence of globally refined
+//! grids, the time includes the refinement
+template<class Grid, int variant, class Function>
+void uniformBenchmark (const std::string& gridName, const std::string& functionName,
+                       const Function& f, double exact,
+                       const BenchmarkParameters& params, BenchmarkTable& table)
+{
+  BenchmarkGrid<Grid,variant> benchmarkGrid;
+  Grid& grid = benchmarkGrid.grid();
+  const auto& comm = grid.comm();
+  CountingFunction<Function> counted(f);
+
+  Dune::Timer timer;
+  for (int step=0; ; step++)
+  {
+    const auto gridView = grid.leafGridView();
+    const double value = integrateGridView(gridView, counted, params.order);
+    const double error = std::abs(value-exact);
+    const long elementCount = interiorElements(gridView);
+    table.add(gridName, functionName, "uniform", step, elementCount,
+              comm.sum(counted.count()), comm.max(timer.elapsed()), value, error);
+
+    if (error <= params.tol*std::abs(exact) || elementCount >= params.maxElements)
+      break;
+    grid.globalRefine(1);
+  }
+}
+
+//! adaptive integration as in adaptiveintegration.cc, with the integral
+//! of order 3 and the error estimate of the embedded rule, marking is
+//! "max" or "bulk". The error reported is the exact one. Each process
+//! works on its interior elements, sums, maxima and the errors for the
+//! bulk criterion are taken over all processes.
+template<class Grid, int variant, class Function>
+void adaptiveBenchmark (const std::string& gridName, const std::string& functionName,
+                        const Function& f, double exact, const std::string& marking,
+                        const BenchmarkParameters& params, BenchmarkTable& table)
+{
+  typedef typename Grid::LeafGridView GridView;
+  typedef typename Grid::template Codim<0>::Entity Element;
+
+  BenchmarkGrid<Grid,variant> benchmarkGrid;
+  Grid& grid = benchmarkGrid.grid();
+  const auto& comm = grid.comm();
+  CountingFunction<Function> counted(f);
+  const GridView gridView = grid.leafGridView();
+
+  QuadratureBuffer<typename Grid::ctype,Grid::dimensionworld> buffer;
+  Dune::PersistentContainer<Grid,ElementIntegrals> cache(grid,0);
+  auto integrals = [&] (const Element& element)
+  {
+    ElementIntegrals& entry = cache[element];
+    if (!entry.valid)
+    {
+      const EmbeddedIntegral result = integrateEntityEmbedded(element,counted,buffer);
+      entry.value = result.value;
+      entry.error = result.error;
+      entry.valid = true;
+    }
+    return entry;
+  };
+
+  const bool bulk = (marking == "bulk");
+  Dune::Timer timer;
+  for (int step=0; step<100; step++)
+  {
+    CompensatedSum sum;
+    for (const auto& element : elements(gridView, Dune::Partitions::interior))
+      sum.add(integrals(element).value);
+    const double value = comm.sum(sum.value());
+    const double error = std::abs(value-exact);
+    const long elementCount = interiorElements(gridView);
+    table.add(gridName, functionName, "adaptive-" + marking, step, elementCount,
+              comm.sum(counted.count()), comm.max(timer.elapsed()), value, error);
+
+    if (error <= params.tol*std::abs(exact) || elementCount >= params.maxElements)
+      break;
+
+    // every element needs a father for the extrapolation of "max"
+    if (step==0)
+    {
+      grid.globalRefine(1);
+      cache.resize();
+      cache.fill(ElementIntegrals());
+      continue;
+    }
+
+    double kappa;
+    if (bulk)
+    {
+      std::vector<double> errors;
+      for (const auto& element : elements(gridView, Dune::Partitions::interior))
+        errors.push_back(integrals(element).error);
+      kappa = bulkThreshold(gatherErrors(comm, errors), params.theta);
+    }
+    else
+    {
+      double maxerror=-1E100;
+      double maxextrapolatederror=-1E100;
+      for (const auto& element : elements(gridView, Dune::Partitions::interior))
+      {
+        const double elementError = integrals(element).error;
+        const double fathererror = integrals(element.father()).error;
+        maxerror = std::max(maxerror,elementError);
+        maxextrapolatederror = std::max(maxextrapolatederror,
+                                        elementError*elementError/(fathererror+1E-30));
+      }
+      kappa = std::min(comm.max(maxextrapolatederror),0.5*comm.max(maxerror));
+    }
+
+    for (const auto& element : elements(gridView, Dune::Partitions::interior))
+    {
+      const double elementError = integrals(element).error;
+      if (elementError>kappa || (bulk && elementError==kappa && elementError>0))
+        grid.mark(1,element);
+    }
+
+    grid.preAdapt();
+    grid.adapt();
+    cache.resize();
+    for (const auto& element : elements(gridView))
+      if (element.isNew())
+        cache[element] = ElementIntegrals();
+    grid.postAdapt();
+  }
+}
+
+//! all strategies for one functor on one grid manager
+template<class Grid, int variant, class Function>
+void benchmarkFunction (const std::string& gridName, const std::string& functionName,
+                        const Function& f, double exact,
+                        const BenchmarkParameters& params, BenchmarkTable& table)
+{
+  uniformBenchmark<Grid,variant>(gridName, functionName, f, exact, params, table);
+  adaptiveBenchmark<Grid,variant>(gridName, functionName, f, exact, "max", params, table);
+  adaptiveBenchmark<Grid,variant>(gridName, functionName, f, exact, "bulk", params, table);
+  if (table.writing())
+    std::cout << "finished " << gridName << " " << functionName << std::endl;
+}
+
+//! both functors on one grid manager
+template<class Grid, int variant>
+void benchmarkGrid (const std::string& gridName, const BenchmarkParameters& params,
+                    BenchmarkTable& table)
+{
+  typedef typename Grid::ctype ctype;
+  benchmarkFunction<Grid,variant>(gridName, "exp", Exp<ctype,2>(), expIntegral(),
+                                  params, table);
+  benchmarkFunction<Grid,variant>(gridName, "needle", Needle<ctype,2>(), needleIntegral(),
+                                  params, table);
+}
+
+int main(int argc, char **argv)
+{
+  // initialize MPI, finalize is done automatically on exit
+  Dune::MPIHelper& helper = Dune::MPIHelper::instance(argc,argv);
+
+  // start try/catch block to get error messages from dune
+  try {
+    using namespace Dune;
+
+    // read options like "-output results.csv -tol 1E-6" from the command line
+    ParameterTree options;
+    ParameterTreeParser::readOptions(argc, argv, options);
+    BenchmarkParameters params;
+    params.order = options.get<int>("order", 3);
+    params.tol = options.get<double>("tol", 1E-6);
+    params.maxElements = options.get<long>("maxelements", 100000);
+    params.theta = options.get<double>("theta", 0.5);
+    const std::string output = options.get<std::string>("output", "integrationbenchmark.csv");
+
+    // all processes do the runs, in which the grids may be distributed,
+    // the results are written by process 0
+    BenchmarkTable table(output, helper.rank() == 0);
+    benchmarkGrid<YaspGrid<2>,1>("yaspgrid", params, table);
+#if HAVE_DUNE_ALUGRID
+    benchmarkGrid<ALUGrid<2,2,simplex,nonconforming>,1>("alugrid", params, table);
+#endif
+#if HAVE_UG
+    benchmarkGrid<UGGrid<2>,2>("uggrid", params, table);
+#endif
+#if HAVE_ALBERTA
+#if ALBERTA_DIM==2
+    benchmarkGrid<AlbertaGrid<2,2>,1>("albertagrid", params, table);
+#endif
+#endif
+    if (helper.rank() == 0)
+      std::cout << "results written to " << output << std::endl;
+  }
+  catch (std::exception & e) {
+    std::cout << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+  catch (...) {
+    std::cout << "Unknown ERROR" << std::endl;
+    return 1;
+  }
+
+  // done
+  return 0;
+}
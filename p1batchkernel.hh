@@ -0,0 +1,241 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_P1BATCHKERNEL_HH__
+#define __DUNE_GRID_HOWTO_P1BATCHKERNEL_HH__
+
+#include <array>
+#include <cmath>
+
+#include <dune/common/fvector.hh>
+
+#include "fixedquadrature.hh"
+#include "shapefunctions.hh"
+
+// P1BatchKernel:
+// local stiffness matrices and right sides of P1 elements on a batch of
+// up to width affine simplices. All element data is stored with the
+// element (lane) index running fastest, so every operation of the
+// computation is a loop over the lanes of fixed length which the
+// compiler turns into SIMD instructions. Unused lanes hold the reference
+// simplex and their results are ignored.
+template<class ctype, int dim, int width>
+class P1BatchKernel
+{
+public:
+  static_assert(dim >= 1 && dim <= 3, "P1BatchKernel is implemented for dim <= 3");
+
+  enum { n = dim + 1 };
+
+  typedef std::array<ctype,width> Lanes;
+  typedef ShapeFunctionTable<ctype,ctype,dim> Table;
+
+  // corner coordinates of the elements
+  Lanes corner[n][dim];
+
+  // the local stiffness matrices and right sides computed by
+  // computeMatrices() and computeRightSides()
+  Lanes A[n][n];
+  Lanes b[n];
+
+  P1BatchKernel ()
+  {
+    clear();
+  }
+
+  // reset all lanes to the reference simplex
+  void clear ()
+  {
+    for (int i = 0; i < n; i++)
+      for (int d = 0; d < dim; d++)
+        corner[i][d].fill((i == d+1) ? 1.0 : 0.0);
+  }
+
+  // store the corners of an element in the given lane
+  template<class Geometry>
+  void load (int lane, const Geometry& geo)
+  {
+    static_assert(int(Geometry::coorddimension) == dim, "P1BatchKernel needs dimworld == dim");
+    for (int i = 0; i < n; i++)
+    {
+      const auto x = geo.corner(i);
+      for (int d = 0; d < dim; d++)
+        corner[i][d][lane] = x[d];
+    }
+  }
+
+  // J_de = x_{e+1,d} - x_{0,d}, its determinant and inverse, enough for
+  // computeRightSides() if the matrices are not needed
+  void jacobians ()
+  {
+    for (int d = 0; d < dim; d++)
+      for (int e = 0; e < dim; e++)
+        for (int l = 0; l < width; l++)
+          jac[d][e][l] = corner[e+1][d][l] - corner[0][d][l];
+
+    if constexpr (dim == 1)
+    {
+      for (int l = 0; l < width; l++)
+      {
+        det[l] = jac[0][0][l];
+        jacInv[0][0][l] = 1.0 / det[l];
+      }
+    }
+    else if constexpr (dim == 2)
+    {
+      for (int l = 0; l < width; l++)
+      {
+        det[l] = jac[0][0][l]*jac[1][1][l] - jac[0][1][l]*jac[1][0][l];
+        const ctype invDet = 1.0 / det[l];
+        jacInv[0][0][l] = jac[1][1][l] * invDet;
+        jacInv[0][1][l] = -jac[0][1][l] * invDet;
+        jacInv[1][0][l] = -jac[1][0][l] * invDet;
+        jacInv[1][1][l] = jac[0][0][l] * invDet;
+      }
+    }
+    else
+    {
+      // adjugate formula, indices are taken modulo 3
+      for (int l = 0; l < width; l++)
+        det[l] = 0.0;
+      for (int j = 0; j < dim; j++)
+        for (int l = 0; l < width; l++)
+          det[l] += jac[0][j][l] * (jac[1][(j+1)%dim][l]*jac[2][(j+2)%dim][l]
+                                    - jac[1][(j+2)%dim][l]*jac[2][(j+1)%dim][l]);
+      for (int i = 0; i < dim; i++)
+        for (int j = 0; j < dim; j++)
+          for (int l = 0; l < width; l++)
+            jacInv[i][j][l] = (jac[(j+1)%dim][(i+1)%dim][l]*jac[(j+2)%dim][(i+2)%dim][l]
+                               - jac[(j+1)%dim][(i+2)%dim][l]*jac[(j+2)%dim][(i+1)%dim][l]) / det[l];
+    }
+  }
+
+  // A_ij = |T| grad phi_i * grad phi_j for all lanes, calls jacobians()
+  void computeMatrices ()
+  {
+    jacobians();
+
+    // gradient of phi_{k+1} is row k of J^{-1}, phi_0 has minus their sum
+    Lanes grad[n][dim];
+    for (int d = 0; d < dim; d++)
+    {
+      for (int l = 0; l < width; l++)
+        grad[0][d][l] = 0.0;
+      for (int k = 0; k < dim; k++)
+        for (int l = 0; l < width; l++)
+        {
+          grad[k+1][d][l] = jacInv[k][d][l];
+          grad[0][d][l] -= jacInv[k][d][l];
+        }
+    }
+
+    Lanes volume;
+    ctype factorial = 1.0;
+    for (int d = 2; d <= dim; d++)
+      factorial *= d;
+    for (int l = 0; l < width; l++)
+      volume[l] = std::abs(det[l]) / factorial;
+
+    for (int i = 0; i < n; i++)
+      for (int j = i; j < n; j++)
+      {
+        Lanes sum;
+        sum.fill(0.0);
+        for (int d = 0; d < dim; d++)
+          for (int l = 0; l < width; l++)
+            sum[l] += grad[i][d][l] * grad[j][d][l];
+        for (int l = 0; l < width; l++)
+          A[i][j][l] = A[j][i][l] = sum[l] * volume[l];
+      }
+  }
+
+  // b_i = integral of f phi_i, with the quadrature points and shape
+  // function values of the table, needs jacobians() or computeMatrices()
+  // before
+  template<class Function>
+  void computeRightSides (const Function& f, const Table& table, int lanes = width)
+  {
+    for (int i = 0; i < n; i++)
+      b[i].fill(0.0);
+
+    for (int q = 0; q < table.size(); q++)
+    {
+      // global coordinates x = x_0 + J xi of the point in all lanes
+      const Dune::FieldVector<ctype,dim>& xi = table.position(q);
+      Lanes x[dim];
+      for (int d = 0; d < dim; d++)
+      {
+        x[d] = corner[0][d];
+        for (int e = 0; e < dim; e++)
+          for (int l = 0; l < width; l++)
+            x[d][l] += jac[d][e][l] * xi[e];
+      }
+
+      // the function itself is evaluated lane by lane
+      Lanes fval;
+      fval.fill(0.0);
+      for (int l = 0; l < lanes; l++)
+      {
+        Dune::FieldVector<ctype,dim> global;
+        for (int d = 0; d < dim; d++)
+          global[d] = x[d][l];
+        fval[l] = f(global);
+      }
+
+      const ctype* phi = table.values(q);
+      for (int i = 0; i < n; i++)
+        for (int l = 0; l < width; l++)
+          b[i][l] += table.weight(q) * std::abs(det[l]) * phi[i] * fval[l];
+    }
+  }
+
+  // b_i = integral of f phi_i with a FixedSimplexRule, the shape functions
+  // are the barycentric coordinates of its points. The operations are
+  // those of the scalar assembly in finiteelements.cc, so both give the
+  // same right sides. Needs jacobians() or computeMatrices() before.
+  template<class Rule, class Function>
+  void computeRightSides (const Function& f, int lanes = width)
+  {
+    for (int i = 0; i < n; i++)
+      b[i].fill(0.0);
+
+    for (int q = 0; q < Rule::size; q++)
+    {
+      const Dune::FieldVector<ctype,dim> xi = fixedRulePoint<Rule,ctype,dim>(q);
+      Lanes x[dim];
+      for (int d = 0; d < dim; d++)
+      {
+        x[d] = corner[0][d];
+        for (int e = 0; e < dim; e++)
+          for (int l = 0; l < width; l++)
+            x[d][l] += jac[d][e][l] * xi[e];
+      }
+
+      Lanes factor;
+      factor.fill(0.0);
+      for (int l = 0; l < lanes; l++)
+      {
+        Dune::FieldVector<ctype,dim> global;
+        for (int d = 0; d < dim; d++)
+          global[d] = x[d][l];
+        factor[l] = Rule::weights[q] * std::abs(det[l]) * f(global);
+      }
+
+      ctype phi0 = 1.0;
+      for (int d = 0; d < dim; d++)
+      {
+        for (int l = 0; l < width; l++)
+          b[d+1][l] += xi[d] * factor[l];
+        phi0 -= xi[d];
+      }
+      for (int l = 0; l < width; l++)
+        b[0][l] += phi0 * factor[l];
+    }
+  }
+
+private:
+  Lanes jac[dim][dim];
+  Lanes jacInv[dim][dim];
+  Lanes det;
+};
+
+#endif // __DUNE_GRID_HOWTO_P1BATCHKERNEL_HH__
@@ -0,0 +1,317 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_P1MATRIXFREE_HH__
+#define __DUNE_GRID_HOWTO_P1MATRIXFREE_HH__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fvector.hh>
+#include <dune/geometry/referenceelements.hh>
+#include <dune/istl/operators.hh>
+#include <dune/istl/preconditioner.hh>
+#include <dune/istl/solvercategory.hh>
+
+#include "shapefunctions.hh"
+
+// P1MatrixFreeOperator:
+// applies the P1 stiffness matrix of the Laplacian element by element
+// without storing it. Rows and columns of Dirichlet vertices are replaced
+// by the identity, which is the symmetric elimination of P1Elements.
+// The element gradients are either recomputed from the geometry in each
+// application or cached, scaled with the square root of the element
+// volume. The cache holds n gradients and n indices per element, in 2d
+// about 60 bytes per element or 120 bytes per vertex, which is as much as
+// the assembled matrix, so only the recomputation saves memory.
+// Only affine simplices are supported, the constructor throws
+// Dune::NotImplemented for any other element.
+template<class GV, class X>
+class P1MatrixFreeOperator : public Dune::LinearOperator<X,X>
+{
+public:
+  typedef X domain_type;
+  typedef X range_type;
+  typedef typename X::field_type field_type;
+
+  static const int dim = GV::dimension;
+  static const int n = dim + 1;
+
+  typedef typename GV::ctype ctype;
+  typedef Dune::FieldVector<ctype,dim> Gradient;
+
+  P1MatrixFreeOperator (const GV& gv, const std::vector<bool>& dirichlet,
+                        bool cacheGradients = false)
+    : gv_(gv), dirichlet_(dirichlet), cached_(cacheGradients)
+  {
+    // compute the diagonal for the smoothers and fill the cache
+    diagonal_.assign(gv_.size(dim), 0.0);
+    if (cached_)
+    {
+      indices_.reserve(n*gv_.size(0));
+      gradients_.reserve(n*gv_.size(0));
+    }
+
+    int index[n];
+    Gradient grad[n];
+    for (const auto& element : elements(gv_))
+    {
+      // the gradients are constant on each element only for these
+      if (!element.type().isSimplex() || !element.geometry().affine())
+        DUNE_THROW(Dune::NotImplemented, "P1MatrixFreeOperator on " << element.type()
+                   << (element.type().isSimplex() ? " with a non-affine geometry" : ""));
+      elementGradients(element, index, grad);
+      for (int i = 0; i < n; i++)
+        diagonal_[index[i]] += grad[i]*grad[i];
+      if (cached_)
+      {
+        indices_.insert(indices_.end(), index, index+n);
+        gradients_.insert(gradients_.end(), grad, grad+n);
+      }
+    }
+
+    for (std::size_t i = 0; i < diagonal_.size(); i++)
+      if (dirichlet_[i])
+        diagonal_[i] = 1.0;
+  }
+
+  void apply (const X& x, X& y) const override
+  {
+    y = 0.0;
+    applyscaleadd(1.0, x, y);
+  }
+
+  void applyscaleadd (field_type alpha, const X& x, X& y) const override
+  {
+    if (cached_)
+    {
+      const std::size_t elementCount = indices_.size()/n;
+      for (std::size_t e = 0; e < elementCount; e++)
+        addElement(alpha, &indices_[e*n], &gradients_[e*n], x, y);
+    }
+    else
+    {
+      int index[n];
+      Gradient grad[n];
+      for (const auto& element : elements(gv_))
+      {
+        elementGradients(element, index, grad);
+        addElement(alpha, index, grad, x, y);
+      }
+    }
+
+    for (std::size_t i = 0; i < dirichlet_.size(); i++)
+      if (dirichlet_[i])
+      {
+        const field_type xi = x[i];
+        y[i] += alpha*xi;
+      }
+  }
+
+  Dune::SolverCategory::Category category () const override
+  {
+    return Dune::SolverCategory::sequential;
+  }
+
+  // diagonal of the operator
+  const std::vector<field_type>& diagonal () const
+  {
+    return diagonal_;
+  }
+
+  // bytes held by the operator
+  std::size_t memory () const
+  {
+    return diagonal_.capacity()*sizeof(field_type)
+           + indices_.capacity()*sizeof(int)
+           + gradients_.capacity()*sizeof(Gradient);
+  }
+
+private:
+  // global vertex indices and transformed gradients of the shape functions,
+  // scaled with the square root of the element volume
+  template<class Element>
+  void elementGradients (const Element& element, int* index, Gradient* grad) const
+  {
+    const P1ShapeFunctionSet<ctype,ctype,dim>& basis = P1ShapeFunctionSet<ctype,ctype,dim>::instance();
+
+    const auto geo = element.geometry();
+    auto ref = referenceElement(geo);
+    const Gradient& center = ref.position(0,0);
+    const auto jacInvTra = geo.jacobianInverseTransposed(center);
+    const ctype scale = std::sqrt(geo.volume());
+
+    for (int i = 0; i < n; i++)
+    {
+      index[i] = gv_.indexSet().subIndex(element,i,dim);
+      jacInvTra.mv(basis[i].evaluateGradient(center),grad[i]);
+      grad[i] *= scale;
+    }
+  }
+
+  // y += alpha * A_e x, the local matrix A_e has the entries grad_i*grad_j,
+  // so it is applied as grad_i * (sum_j x_j grad_j)
+  void addElement (field_type alpha, const int* index, const Gradient* grad,
+                   const X& x, X& y) const
+  {
+    Gradient w(0.0);
+    for (int j = 0; j < n; j++)
+      if (!dirichlet_[index[j]])
+      {
+        const field_type xj = x[index[j]];
+        w.axpy(xj, grad[j]);
+      }
+    for (int i = 0; i < n; i++)
+      if (!dirichlet_[index[i]])
+        y[index[i]] += alpha*(grad[i]*w);
+  }
+
+  const GV& gv_;
+  const std::vector<bool>& dirichlet_;
+  bool cached_;
+  std::vector<field_type> diagonal_;
+  std::vector<int> indices_;
+  std::vector<Gradient> gradients_;
+};
+
+// MatrixFreeJacobi:
+// damped Jacobi preconditioner using the diagonal of an operator
+template<class Operator, class X>
+class MatrixFreeJacobi : public Dune::Preconditioner<X,X>
+{
+public:
+  typedef X domain_type;
+  typedef X range_type;
+  typedef typename X::field_type field_type;
+
+  MatrixFreeJacobi (const Operator& op, field_type omega = 1.0)
+    : op_(op), omega_(omega)
+  {}
+
+  void pre (X& x, X& b) override {}
+
+  void apply (X& v, const X& d) override
+  {
+    const std::vector<field_type>& diagonal = op_.diagonal();
+    for (std::size_t i = 0; i < diagonal.size(); i++)
+    {
+      const field_type di = d[i];
+      v[i] = omega_*di/diagonal[i];
+    }
+  }
+
+  void post (X& x) override {}
+
+  Dune::SolverCategory::Category category () const override
+  {
+    return Dune::SolverCategory::sequential;
+  }
+
+private:
+  const Operator& op_;
+  field_type omega_;
+};
+
+// MatrixFreeChebyshev:
+// Chebyshev iteration of fixed degree for the Jacobi scaled operator,
+// starting from zero. The largest eigenvalue is estimated by a few power
+// iterations, the polynomial targets the upper part of the spectrum
+// [lambdaMax/ratio, lambdaMax]. It is a fixed symmetric polynomial in the
+// operator and can be used as preconditioner for CG.
+template<class Operator, class X>
+class MatrixFreeChebyshev : public Dune::Preconditioner<X,X>
+{
+public:
+  typedef X domain_type;
+  typedef X range_type;
+  typedef typename X::field_type field_type;
+
+  MatrixFreeChebyshev (const Operator& op, int degree = 4,
+                       field_type ratio = 30.0, int powerIterations = 20)
+    : op_(op), degree_(degree)
+  {
+    const std::vector<field_type>& diagonal = op_.diagonal();
+    const std::size_t size = diagonal.size();
+
+    // power iteration for the largest eigenvalue of D^{-1}A
+    X x(size), y(size);
+    for (std::size_t i = 0; i < size; i++)
+      x[i] = 1.0 + (i % 7);
+    x /= x.two_norm();
+    field_type lambda = 1.0;
+    for (int k = 0; k < powerIterations; k++)
+    {
+      op_.apply(x, y);
+      for (std::size_t i = 0; i < size; i++)
+        y[i] *= 1.0/diagonal[i];
+      lambda = y.two_norm();
+      x = y;
+      x /= lambda;
+    }
+
+    // safety margin, the power iteration underestimates lambdaMax
+    lambdaMax_ = 1.1*lambda;
+    lambdaMin_ = lambdaMax_/ratio;
+  }
+
+  void pre (X& x, X& b) override {}
+
+  void apply (X& v, const X& d) override
+  {
+    const std::vector<field_type>& diagonal = op_.diagonal();
+    const std::size_t size = diagonal.size();
+
+    const field_type theta = 0.5*(lambdaMax_+lambdaMin_);
+    const field_type delta = 0.5*(lambdaMax_-lambdaMin_);
+    const field_type sigma = theta/delta;
+    field_type rho = 1.0/sigma;
+
+    // preconditioned residual r and update direction p
+    X r(size), p(size), q(size);
+    for (std::size_t i = 0; i < size; i++)
+    {
+      const field_type di = d[i];
+      r[i] = di/diagonal[i];
+    }
+    p = r;
+    p /= theta;
+    v = 0.0;
+
+    for (int k = 0; k < degree_; k++)
+    {
+      v += p;
+      if (k+1 == degree_)
+        break;
+
+      // r -= D^{-1} A p
+      op_.apply(p, q);
+      for (std::size_t i = 0; i < size; i++)
+      {
+        const field_type qi = q[i];
+        r[i] -= qi/diagonal[i];
+      }
+
+      const field_type rhoNew = 1.0/(2.0*sigma-rho);
+      p *= rhoNew*rho;
+      p.axpy(2.0*rhoNew/delta, r);
+      rho = rhoNew;
+    }
+  }
+
+  void post (X& x) override {}
+
+  Dune::SolverCategory::Category category () const override
+  {
+    return Dune::SolverCategory::sequential;
+  }
+
+private:
+  const Operator& op_;
+  int degree_;
+  field_type lambdaMin_;
+  field_type lambdaMax_;
+};
+
+#endif // __DUNE_GRID_HOWTO_P1MATRIXFREE_HH__
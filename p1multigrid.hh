@@ -0,0 +1,267 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_P1MULTIGRID_HH__
+#define __DUNE_GRID_HOWTO_P1MULTIGRID_HH__
+
+#include <cmath>
+#include <vector>
+
+#include <dune/common/dynmatrix.hh>
+#include <dune/common/exceptions.hh>
+#include <dune/geometry/referenceelements.hh>
+#include <dune/istl/gsetc.hh>
+#include <dune/istl/preconditioner.hh>
+#include <dune/istl/solvercategory.hh>
+
+#include "csrpattern.hh"
+#include "shapefunctions.hh"
+
+//! mark all vertices of a grid view which lie on the domain boundary
+template<class GV>
+std::vector<bool> boundaryVertices (const GV& gv)
+{
+  const int dim = GV::dimension;
+
+  std::vector<bool> boundary(gv.size(dim), false);
+  for (const auto& element : elements(gv))
+  {
+    auto ref = referenceElement(element.geometry());
+    for (const auto& intersection : intersections(gv, element))
+      if (intersection.boundary())
+      {
+        const int face = intersection.indexInInside();
+        for (int i = 0; i < ref.size(face,1,dim); i++)
+          boundary[gv.indexSet().subIndex(element,ref.subEntity(face,1,i,dim),dim)] = true;
+      }
+  }
+  return boundary;
+}
+
+//! P1 prolongation from level coarseLevel of a simplicial grid to the next
+//! finer level, whose vertices are numbered by fineSet. Rows of fine and
+//! columns of coarse Dirichlet vertices are left empty, so that the
+//! prolongation maps interior coarse functions to interior fine functions.
+template<class Grid, class IndexSet, class Matrix>
+void p1Prolongation (const Grid& grid, int coarseLevel, const IndexSet& fineSet,
+                     const std::vector<bool>& coarseDirichlet,
+                     const std::vector<bool>& fineDirichlet, Matrix& P)
+{
+  const int dim = Grid::dimension;
+  typedef typename Grid::ctype ctype;
+
+  const P1ShapeFunctionSet<ctype,ctype,dim>& basis = P1ShapeFunctionSet<ctype,ctype,dim>::instance();
+  const auto& coarseSet = grid.levelIndexSet(coarseLevel);
+  const auto fineView = grid.levelGridView(coarseLevel+1);
+
+  // the weight of coarse vertex m at fine vertex k of an element is the
+  // value of the m-th shape function of the father at the position of k
+  auto couplings = [&](auto add)
+  {
+    for (const auto& element : elements(fineView))
+    {
+      const auto father = element.father();
+      const auto geometryInFather = element.geometryInFather();
+      for (int k = 0; k < geometryInFather.corners(); k++)
+      {
+        const int row = fineSet.subIndex(element,k,dim);
+        if (fineDirichlet[row])
+          continue;
+        for (int m = 0; m < dim+1; m++)
+        {
+          const int col = coarseSet.subIndex(father,m,dim);
+          const ctype weight = basis[m].evaluateFunction(geometryInFather.corner(k));
+          if (!coarseDirichlet[col] && std::abs(weight) > 1e-12)
+            add(row, col, weight);
+        }
+      }
+    }
+  };
+
+  CSRPattern pattern;
+  pattern.build(fineDirichlet.size(), [&](auto addCouplings)
+  {
+    couplings([&](int row, int col, ctype weight)
+    {
+      addCouplings(&row, 1, &col, 1);
+    });
+  });
+  pattern.setupMatrix(P, coarseDirichlet.size());
+
+  // continuity of the P1 functions gives the same weight for each father
+  P = 0.0;
+  couplings([&](int row, int col, ctype weight)
+  {
+    P[row][col] = weight;
+  });
+}
+
+// P1GeometricMultigrid:
+// symmetric V-cycle on the refinement hierarchy of a uniformly refined
+// simplicial grid. The coarse operators are Galerkin products of the
+// fine matrix with the P1 prolongations between the levels, the smoother
+// is Gauss-Seidel (forward before, backward after the coarse grid
+// correction) and the coarsest level is solved exactly.
+template<class Grid, class Matrix, class X>
+class P1GeometricMultigrid : public Dune::Preconditioner<X,X>
+{
+public:
+  typedef X domain_type;
+  typedef X range_type;
+  typedef typename X::field_type field_type;
+
+  static const int dim = Grid::dimension;
+
+  // A is the matrix on the leaf grid, dirichlet marks its Dirichlet rows
+  P1GeometricMultigrid (const Grid& grid, const Matrix& A,
+                        const std::vector<bool>& dirichlet, int smoothingSteps = 1)
+    : fine_(A), maxLevel_(grid.maxLevel()), smoothingSteps_(smoothingSteps)
+  {
+    if (grid.size(maxLevel_,0) != grid.size(0))
+      DUNE_THROW(Dune::NotImplemented,
+                 "geometric multigrid needs a uniformly refined grid");
+
+    matrices_.resize(maxLevel_);
+    prolongations_.resize(maxLevel_);
+
+    // Dirichlet vertices of all levels, the finest one in leaf numbering
+    std::vector< std::vector<bool> > levelDirichlet(maxLevel_+1);
+    for (int level = 0; level < maxLevel_; level++)
+      levelDirichlet[level] = boundaryVertices(grid.levelGridView(level));
+    levelDirichlet[maxLevel_] = dirichlet;
+
+    for (int level = maxLevel_-1; level >= 0; level--)
+    {
+      if (level == maxLevel_-1)
+        p1Prolongation(grid, level, grid.leafIndexSet(),
+                       levelDirichlet[level], levelDirichlet[level+1], prolongations_[level]);
+      else
+        p1Prolongation(grid, level, grid.levelIndexSet(level+1),
+                       levelDirichlet[level], levelDirichlet[level+1], prolongations_[level]);
+      galerkinProduct(grid, level, levelDirichlet[level]);
+    }
+
+    // invert the coarsest matrix
+    const Matrix& A0 = matrix(0);
+    coarseInverse_.resize(A0.N(), A0.M(), 0.0);
+    for (auto row = A0.begin(); row != A0.end(); ++row)
+      for (auto col = row->begin(); col != row->end(); ++col)
+        coarseInverse_[row.index()][col.index()] = (*col)[0][0];
+    coarseInverse_.invert();
+  }
+
+  void pre (X& x, X& b) override {}
+
+  void apply (X& v, const X& d) override
+  {
+    vcycle(maxLevel_, v, d);
+  }
+
+  void post (X& x) override {}
+
+  Dune::SolverCategory::Category category () const override
+  {
+    return Dune::SolverCategory::sequential;
+  }
+
+  int levels () const
+  {
+    return maxLevel_+1;
+  }
+
+private:
+  const Matrix& matrix (int level) const
+  {
+    return (level == maxLevel_) ? fine_ : matrices_[level];
+  }
+
+  // A_l = P^T A_{l+1} P on the interior vertices, identity on the
+  // Dirichlet vertices. For nested P1 spaces the coarse couplings are the
+  // couplings of the coarse elements.
+  void galerkinProduct (const Grid& grid, int level, const std::vector<bool>& coarseDirichlet)
+  {
+    const auto coarseView = grid.levelGridView(level);
+    const auto& coarseSet = coarseView.indexSet();
+    const Matrix& A = matrix(level+1);
+    const Matrix& P = prolongations_[level];
+    Matrix& Ac = matrices_[level];
+
+    CSRPattern pattern;
+    pattern.build(coarseDirichlet.size(), [&](auto addCouplings)
+    {
+      for (const auto& element : elements(coarseView))
+      {
+        int index[dim+1];
+        for (int i = 0; i < dim+1; i++)
+          index[i] = coarseSet.subIndex(element,i,dim);
+        addCouplings(index, dim+1, index, dim+1);
+      }
+    });
+    pattern.setupMatrix(Ac, coarseDirichlet.size());
+    Ac = 0.0;
+
+    for (auto row = A.begin(); row != A.end(); ++row)
+    {
+      const auto& Prow = P[row.index()];
+      for (auto col = row->begin(); col != row->end(); ++col)
+      {
+        const auto& Pcol = P[col.index()];
+        const field_type a = (*col)[0][0];
+        for (auto pi = Prow.begin(); pi != Prow.end(); ++pi)
+          for (auto pj = Pcol.begin(); pj != Pcol.end(); ++pj)
+            Ac[pi.index()][pj.index()] += (*pi)[0][0] * a * (*pj)[0][0];
+      }
+    }
+
+    for (std::size_t i = 0; i < coarseDirichlet.size(); i++)
+      if (coarseDirichlet[i])
+        Ac[i][i] = 1.0;
+  }
+
+  // one V-cycle for A_l x = b starting from zero
+  void vcycle (int level, X& x, const X& b) const
+  {
+    if (level == 0)
+    {
+      for (std::size_t i = 0; i < coarseInverse_.N(); i++)
+      {
+        field_type sum = 0.0;
+        for (std::size_t j = 0; j < coarseInverse_.M(); j++)
+        {
+          const field_type bj = b[j];
+          sum += coarseInverse_[i][j]*bj;
+        }
+        x[i] = sum;
+      }
+      return;
+    }
+
+    const Matrix& A = matrix(level);
+    const Matrix& P = prolongations_[level-1];
+
+    // presmoothing
+    x = 0.0;
+    for (int k = 0; k < smoothingSteps_; k++)
+      Dune::bsorf(A, x, b, 1.0);
+
+    // restrict the residual and solve the coarse defect equation
+    X r(b);
+    A.mmv(x, r);
+    X rc(P.M()), xc(P.M());
+    P.mtv(r, rc);
+    vcycle(level-1, xc, rc);
+    P.umv(xc, x);
+
+    // postsmoothing
+    for (int k = 0; k < smoothingSteps_; k++)
+      Dune::bsorb(A, x, b, 1.0);
+  }
+
+  const Matrix& fine_;
+  int maxLevel_;
+  int smoothingSteps_;
+  std::vector<Matrix> matrices_;
+  std::vector<Matrix> prolongations_;
+  Dune::DynamicMatrix<field_type> coarseInverse_;
+};
+
+#endif // __DUNE_GRID_HOWTO_P1MULTIGRID_HH__
@@ -0,0 +1,581 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_P1PARALLEL_HH__
+#define __DUNE_GRID_HOWTO_P1PARALLEL_HH__
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fmatrix.hh>
+#include <dune/common/fvector.hh>
+#include <dune/common/timer.hh>
+#include <dune/geometry/quadraturerules.hh>
+#include <dune/geometry/referenceelements.hh>
+#include <dune/grid/common/datahandleif.hh>
+#include <dune/grid/common/gridenums.hh>
+#include <dune/grid/utility/globalindexset.hh>
+#include <dune/istl/bcrsmatrix.hh>
+#include <dune/istl/bvector.hh>
+#include <dune/istl/ilu.hh>
+#include <dune/istl/owneroverlapcopy.hh>
+#include <dune/istl/preconditioners.hh>
+#include <dune/istl/schwarz.hh>
+#include <dune/istl/solvers.hh>
+#include <dune/istl/paamg/amg.hh>
+
+#include "affinegeometry.hh"
+#include "csrpattern.hh"
+#include "shapefunctions.hh"
+
+// A DataHandle class to combine the entries of a vertex vector on all
+// processes sharing a vertex, e.g. with the minimum or the maximum
+template<class IS, class V, class Combine> // index set, vector and functor type
+class VertexCombineExchange
+  : public Dune::CommDataHandleIF<VertexCombineExchange<IS,V,Combine>,
+        typename V::value_type>
+{
+public:
+  //! export type of data for message buffer
+  typedef typename V::value_type DataType;
+
+  //! returns true if data for this codim should be communicated
+  bool contains (int dim, int codim) const
+  {
+    return (codim==dim);
+  }
+
+  //! returns true if size per entity of given dim and codim is a constant
+  bool fixedSize (int dim, int codim) const
+  {
+    return true;
+  }
+
+  //! how many objects of type DataType have to be sent for a given entity
+  template<class EntityType>
+  size_t size (EntityType& e) const
+  {
+    return 1;
+  }
+
+  //! pack data from user to message buffer
+  template<class MessageBuffer, class EntityType>
+  void gather (MessageBuffer& buff, const EntityType& e) const
+  {
+    buff.write(v[set.index(e)]);
+  }
+
+  //! combine the received data with the own entry
+  template<class MessageBuffer, class EntityType>
+  void scatter (MessageBuffer& buff, const EntityType& e, size_t n)
+  {
+    DataType x;
+    buff.read(x);
+    v[set.index(e)] = combine(v[set.index(e)],x);
+  }
+
+  //! constructor
+  VertexCombineExchange (const IS& set_, V& v_, Combine combine_)
+    : set(set_), v(v_), combine(combine_)
+  {}
+
+private:
+  const IS& set;
+  V& v;
+  Combine combine;
+};
+
+// one entry of a matrix row sent to another process, the column is given
+// by its global index. The first entry of each row carries the right side.
+struct P1RowEntry
+{
+  int column;
+  int dirichlet;
+  double value;
+};
+
+// A DataHandle class to send the partially assembled rows of the border
+// vertices to the other processes sharing them
+template<class IS, class Matrix, class V>
+class P1RowExchange
+  : public Dune::CommDataHandleIF<P1RowExchange<IS,Matrix,V>,P1RowEntry>
+{
+public:
+  //! export type of data for message buffer
+  typedef P1RowEntry DataType;
+
+  // a received entry (row, global column) of the matrix
+  struct Coupling
+  {
+    int row;
+    P1RowEntry entry;
+  };
+
+  bool contains (int dim, int codim) const
+  {
+    return (codim==dim);
+  }
+
+  //! the number of entries differs from row to row
+  bool fixedSize (int dim, int codim) const
+  {
+    return false;
+  }
+
+  template<class EntityType>
+  size_t size (EntityType& e) const
+  {
+    const int row = localIndex[set.index(e)];
+    return (row < 0) ? 0 : 1 + A[row].size();
+  }
+
+  template<class MessageBuffer, class EntityType>
+  void gather (MessageBuffer& buff, const EntityType& e) const
+  {
+    const int row = localIndex[set.index(e)];
+    if (row < 0)
+      return;
+    buff.write(P1RowEntry{-1, 0, b[row][0]});
+    for (auto col = A[row].begin(); col != A[row].end(); ++col)
+      buff.write(P1RowEntry{globalIndex[col.index()], int(dirichlet[col.index()]), (*col)[0][0]});
+  }
+
+  //! received rows are only stored, the owner adds them after the exchange
+  template<class MessageBuffer, class EntityType>
+  void scatter (MessageBuffer& buff, const EntityType& e, size_t n)
+  {
+    const int row = localIndex[set.index(e)];
+    for (size_t i = 0; i < n; i++)
+    {
+      P1RowEntry entry;
+      buff.read(entry);
+      if (row >= 0 && owner[row])
+        received.push_back(Coupling{row, entry});
+    }
+  }
+
+  P1RowExchange (const IS& set_, const std::vector<int>& localIndex_,
+                 const std::vector<int>& globalIndex_, const std::vector<bool>& owner_,
+                 const std::vector<bool>& dirichlet_, const Matrix& A_, const V& b_)
+    : set(set_), localIndex(localIndex_), globalIndex(globalIndex_), owner(owner_),
+      dirichlet(dirichlet_), A(A_), b(b_)
+  {}
+
+  std::vector<Coupling> received;
+
+private:
+  const IS& set;
+  const std::vector<int>& localIndex;
+  const std::vector<int>& globalIndex;
+  const std::vector<bool>& owner;
+  const std::vector<bool>& dirichlet;
+  const Matrix& A;
+  const V& b;
+};
+
+// ParallelP1Elements:
+// P1 finite elements for the Poisson problem with homogeneous Dirichlet
+// boundary conditions on a distributed simplicial grid. Each process
+// assembles on its interior elements, the rows of vertices on the
+// process borders are completed by the process owning the vertex. The
+// vertices are numbered locally for ISTL, each one is owned by exactly
+// one process and the other processes hold copies with unit rows. This is
+// the overlapping model of OwnerOverlapCopyCommunication, where the
+// matrix rows of all owned vertices are complete.
+template<class GV, class F>
+class ParallelP1Elements
+{
+public:
+  static const int dim = GV::dimension;
+
+  typedef typename GV::ctype ctype;
+  typedef Dune::BCRSMatrix<Dune::FieldMatrix<ctype,1,1> > Matrix;
+  typedef Dune::BlockVector<Dune::FieldVector<ctype,1> > ScalarField;
+  typedef Dune::OwnerOverlapCopyCommunication<int,int> Communication;
+
+private:
+  typedef typename GV::IndexSet LeafIndexSet;
+
+  // number of P1 shape functions on a simplex
+  static const int n = dim + 1;
+
+  const GV& gv;
+  const F& f;
+
+  // local index of each vertex of the index set, -1 for vertices not in
+  // any interior element
+  std::vector<int> localIndex;
+
+  // global index, ownership and Dirichlet flag of each local index
+  std::vector<int> globalIndex;
+  std::vector<bool> owner;
+  std::vector<bool> dirichlet;
+
+  // assemble the local stiffness matrix and right side of one element
+  template<class Element>
+  void assembleElement(const Element& element, Dune::FieldMatrix<ctype,n,n>& localA,
+                       Dune::FieldVector<ctype,n>& localb) const;
+
+public:
+  Matrix A;
+  ScalarField b;
+  ScalarField u;
+  Communication comm;
+
+  ParallelP1Elements(const GV& gv_, const F& f_)
+    : gv(gv_), f(f_), comm(gv_.comm()) {}
+
+  // number the vertices, assemble A and b on the interior elements and
+  // complete the rows of the owned border vertices
+  void assemble();
+
+  // iteration count and timings of one linear solve
+  struct SolverStatistics
+  {
+    int iterations;
+    bool converged;
+    double reduction;
+    double setupTime;
+    double solveTime;
+  };
+
+  // solve Au = b with "ilu-bicgstab", "ilu-cg" (overlapping Schwarz with
+  // a local ILU on each process) or "amg-bicgstab", "amg-cg" (parallel
+  // algebraic multigrid)
+  SolverStatistics solve(const std::string& solverType = "amg-cg",
+                         double reduction = 1e-10);
+
+  // u in the numbering of the leaf index set, zero on vertices which are
+  // not in any interior element
+  ScalarField solution() const;
+
+  // number of vertices owned by this process
+  int ownedSize() const
+  {
+    return std::count(owner.begin(), owner.end(), true);
+  }
+};
+
+template<class GV, class F>
+template<class Element>
+void ParallelP1Elements<GV, F>::assembleElement(const Element& element,
+                                                Dune::FieldMatrix<ctype,n,n>& localA,
+                                                Dune::FieldVector<ctype,n>& localb) const
+{
+  const P1ShapeFunctionSet<ctype,ctype,dim>& basis = P1ShapeFunctionSet<ctype,ctype,dim>::instance();
+
+  const auto geo = element.geometry();
+  auto ref = referenceElement(geo);
+
+  // the transformed gradients are constant on affine simplices
+  AffineGeometryCache<ctype,dim,GV::dimensionworld> affine;
+  if (!affine.bind(geo))
+    DUNE_THROW(Dune::NotImplemented, "ParallelP1Elements needs affine simplices");
+  const Dune::FieldVector<ctype,dim>& center = ref.position(0,0);
+  const ctype volume = geo.volume();
+  Dune::FieldVector<ctype,dim> grad[n];
+  for (int i = 0; i < n; i++)
+    affine.jacobianInverseTransposed().mv(basis[i].evaluateGradient(center),grad[i]);
+  for (int i = 0; i < n; i++)
+    for (int j = i; j < n; j++)
+      localA[i][j] = localA[j][i] = (grad[i]*grad[j]) * volume;
+
+  localb = 0.0;
+  const Dune::QuadratureRule<ctype,dim>& rule = Dune::QuadratureRules<ctype,dim>::rule(element.type(),2);
+  for (const auto& qp : rule)
+  {
+    const ctype factor = qp.weight() * affine.integrationElement() * f(affine.global(qp.position()));
+    for (int i = 0; i < n; i++)
+      localb[i] += basis[i].evaluateFunction(qp.position()) * factor;
+  }
+}
+
+template<class GV, class F>
+void ParallelP1Elements<GV, F>::assemble()
+{
+  const LeafIndexSet& set = gv.indexSet();
+  const int rank = gv.comm().rank();
+
+  // number the vertices of the interior elements locally and get their
+  // global indices
+  Dune::GlobalIndexSet<GV> globalSet(gv, dim);
+  localIndex.assign(set.size(dim), -1);
+  globalIndex.clear();
+  for (const auto& element : elements(gv, Dune::Partitions::interior))
+    for (int i = 0; i < n; i++)
+    {
+      const int k = set.subIndex(element,i,dim);
+      if (localIndex[k] < 0)
+      {
+        localIndex[k] = globalIndex.size();
+        globalIndex.push_back(globalSet.index(element.template subEntity<dim>(i)));
+      }
+    }
+  const int localSize = globalIndex.size();
+
+  // a vertex on the process border is owned by the smallest rank sharing it
+  std::vector<int> ownerRank(set.size(dim), rank);
+  auto minimum = [] (int a, int b) { return std::min(a,b); };
+  VertexCombineExchange<LeafIndexSet,std::vector<int>,decltype(minimum)> rankExchange(set, ownerRank, minimum);
+  gv.communicate(rankExchange, Dune::InteriorBorder_InteriorBorder_Interface, Dune::ForwardCommunication);
+
+  // mark the vertices on the domain boundary, a border vertex may lie on
+  // boundary faces of other processes only
+  std::vector<int> boundary(set.size(dim), 0);
+  for (const auto& element : elements(gv, Dune::Partitions::interior))
+  {
+    auto ref = referenceElement(element.geometry());
+    for (const auto& intersection : intersections(gv, element))
+      if (intersection.boundary())
+      {
+        const int face = intersection.indexInInside();
+        for (int i = 0; i < ref.size(face,1,dim); i++)
+          boundary[set.subIndex(element,ref.subEntity(face,1,i,dim),dim)] = 1;
+      }
+  }
+  auto maximum = [] (int a, int b) { return std::max(a,b); };
+  VertexCombineExchange<LeafIndexSet,std::vector<int>,decltype(maximum)> boundaryExchange(set, boundary, maximum);
+  gv.communicate(boundaryExchange, Dune::InteriorBorder_InteriorBorder_Interface, Dune::ForwardCommunication);
+
+  owner.assign(localSize, false);
+  dirichlet.assign(localSize, false);
+  for (std::size_t k = 0; k < localIndex.size(); k++)
+    if (localIndex[k] >= 0)
+    {
+      owner[localIndex[k]] = (ownerRank[k] == rank);
+      dirichlet[localIndex[k]] = boundary[k];
+    }
+
+  // assemble on the interior elements, the rows of border vertices only
+  // hold the contributions of this process
+  auto elementIndices = [&] (const auto& element, int* index)
+  {
+    for (int i = 0; i < n; i++)
+      index[i] = localIndex[set.subIndex(element,i,dim)];
+  };
+  CSRPattern localPattern;
+  localPattern.build(localSize, [&](auto addCouplings)
+  {
+    int index[n];
+    for (const auto& element : elements(gv, Dune::Partitions::interior))
+    {
+      elementIndices(element, index);
+      addCouplings(index, n, index, n);
+    }
+  });
+
+  Matrix localA;
+  localPattern.setupMatrix(localA, localSize);
+  localA = 0.0;
+  ScalarField localb(localSize);
+  localb = 0.0;
+
+  int index[n];
+  Dune::FieldMatrix<ctype,n,n> elementA;
+  Dune::FieldVector<ctype,n> elementb;
+  for (const auto& element : elements(gv, Dune::Partitions::interior))
+  {
+    elementIndices(element, index);
+    assembleElement(element, elementA, elementb);
+    for (int i = 0; i < n; i++)
+    {
+      for (int j = 0; j < n; j++)
+        localA[index[i]][index[j]] += elementA[i][j];
+      localb[index[i]] += elementb[i];
+    }
+  }
+
+  // send the partial rows of the border vertices to the other processes
+  P1RowExchange<LeafIndexSet,Matrix,ScalarField>
+    rowExchange(set, localIndex, globalIndex, owner, dirichlet, localA, localb);
+  gv.communicate(rowExchange, Dune::InteriorBorder_InteriorBorder_Interface, Dune::ForwardCommunication);
+
+  // columns of received entries which are not known yet are vertices in
+  // the interior of other processes, they are appended as copies
+  std::unordered_map<int,int> globalToLocal;
+  for (int i = 0; i < localSize; i++)
+    globalToLocal[globalIndex[i]] = i;
+  std::vector<int> receivedColumns(rowExchange.received.size(), -1);
+  for (std::size_t k = 0; k < rowExchange.received.size(); k++)
+  {
+    const P1RowEntry& entry = rowExchange.received[k].entry;
+    if (entry.column < 0)
+      continue;
+    auto it = globalToLocal.find(entry.column);
+    if (it == globalToLocal.end())
+    {
+      it = globalToLocal.emplace(entry.column, globalIndex.size()).first;
+      globalIndex.push_back(entry.column);
+      owner.push_back(false);
+      dirichlet.push_back(entry.dirichlet);
+    }
+    receivedColumns[k] = it->second;
+  }
+  const int N = globalIndex.size();
+
+  // the final pattern contains the local couplings, the received ones and
+  // the diagonal of the appended copies
+  CSRPattern pattern;
+  pattern.build(N, [&](auto addCouplings)
+  {
+    for (int i = 0; i < localSize; i++)
+      addCouplings(&i, 1, localPattern.begin(i), localPattern.rowSize(i));
+    for (std::size_t k = 0; k < rowExchange.received.size(); k++)
+      if (receivedColumns[k] >= 0)
+        addCouplings(&rowExchange.received[k].row, 1, &receivedColumns[k], 1);
+    for (int i = localSize; i < N; i++)
+      addCouplings(&i, 1, &i, 1);
+  });
+  pattern.setupMatrix(A, N);
+
+  A = 0.0;
+  b.resize(N);
+  b = 0.0;
+  for (auto row = localA.begin(); row != localA.end(); ++row)
+  {
+    for (auto col = row->begin(); col != row->end(); ++col)
+      A[row.index()][col.index()] = *col;
+    b[row.index()] = localb[row.index()];
+  }
+  for (std::size_t k = 0; k < rowExchange.received.size(); k++)
+  {
+    const auto& coupling = rowExchange.received[k];
+    if (receivedColumns[k] >= 0)
+      A[coupling.row][receivedColumns[k]] += coupling.entry.value;
+    else
+      b[coupling.row] += coupling.entry.value;
+  }
+
+  // homogeneous Dirichlet values
+  const ctype g = 0.0;
+
+  // eliminate the Dirichlet columns symmetrically in the owned rows and
+  // replace the rows of Dirichlet vertices and copies by trivial lines
+  for (auto row = A.begin(); row != A.end(); ++row)
+  {
+    const int i = row.index();
+    if (owner[i] && !dirichlet[i])
+    {
+      for (auto col = row->begin(); col != row->end(); ++col)
+        if (dirichlet[col.index()])
+        {
+          b[i] -= (*col)[0][0] * g;
+          *col = 0.0;
+        }
+    }
+    else
+    {
+      *row = 0.0;
+      A[i][i] = 1.0;
+      b[i] = dirichlet[i] ? g : 0.0;
+    }
+  }
+
+  // set up the parallel index set, the remote indices are found by
+  // matching the global indices of all processes
+  comm.indexSet().beginResize();
+  for (int i = 0; i < N; i++)
+    comm.indexSet().add(globalIndex[i],
+                        Communication::LI(i, owner[i] ? Dune::OwnerOverlapCopyAttributeSet::owner
+                                                      : Dune::OwnerOverlapCopyAttributeSet::copy, true));
+  comm.indexSet().endResize();
+  comm.remoteIndices().template rebuild<false>();
+}
+
+template<class GV, class F>
+typename ParallelP1Elements<GV, F>::SolverStatistics
+ParallelP1Elements<GV, F>::solve(const std::string& solverType, double reduction)
+{
+  typedef Dune::OverlappingSchwarzOperator<Matrix,ScalarField,ScalarField,Communication> Operator;
+  typedef Dune::OverlappingSchwarzScalarProduct<ScalarField,Communication> ScalarProduct;
+  typedef Dune::Preconditioner<ScalarField,ScalarField> Preconditioner;
+  typedef Dune::InverseOperator<ScalarField,ScalarField> Solver;
+
+  // split solverType into preconditioner and Krylov method
+  const std::string::size_type dash = solverType.find('-');
+  const std::string precType = solverType.substr(0, dash);
+  const std::string krylovType = (dash == std::string::npos) ? "" : solverType.substr(dash+1);
+
+  SolverStatistics stats;
+  Dune::Timer timer;
+
+  Operator op(A, comm);
+  ScalarProduct sp(comm);
+
+  std::shared_ptr<Preconditioner> local;
+  std::shared_ptr<Preconditioner> prec;
+  if (precType == "ilu")
+  {
+    // additive Schwarz: ILU on each process, the results are made
+    // consistent on the copies afterwards
+    typedef Dune::SeqILU<Matrix,ScalarField,ScalarField> ILU;
+    std::shared_ptr<ILU> ilu = std::make_shared<ILU>(A, 1, 0.92);
+    prec = std::make_shared<Dune::BlockPreconditioner<ScalarField,ScalarField,Communication,ILU> >(*ilu, comm);
+    local = ilu;
+  }
+  else if (precType == "amg")
+  {
+    // aggregation based AMG with the block SSOR method as smoother
+    typedef Dune::SeqSSOR<Matrix,ScalarField,ScalarField> SeqSmoother;
+    typedef Dune::BlockPreconditioner<ScalarField,ScalarField,Communication,SeqSmoother> Smoother;
+    typedef Dune::Amg::CoarsenCriterion<
+        Dune::Amg::SymmetricCriterion<Matrix,Dune::Amg::FirstDiagonal> > Criterion;
+
+    typename Dune::Amg::SmootherTraits<Smoother>::Arguments smootherArgs;
+    smootherArgs.iterations = 1;
+    smootherArgs.relaxationFactor = 1.0;
+
+    Criterion criterion(15, 2000);
+    criterion.setDefaultValuesIsotropic(dim);
+    criterion.setDebugLevel(0);
+
+    prec = std::make_shared<Dune::Amg::AMG<Operator,ScalarField,Smoother,Communication> >(op, criterion, smootherArgs, comm);
+  }
+  else
+    DUNE_THROW(Dune::Exception, "unknown preconditioner " << precType);
+
+  std::shared_ptr<Solver> solver;
+  if (krylovType == "bicgstab")
+    solver = std::make_shared<Dune::BiCGSTABSolver<ScalarField> >(op, sp, *prec, reduction, 5000, 0);
+  else if (krylovType == "cg")
+    solver = std::make_shared<Dune::CGSolver<ScalarField> >(op, sp, *prec, reduction, 5000, 0);
+  else
+    DUNE_THROW(Dune::Exception, "unknown Krylov method " << krylovType);
+  stats.setupTime = timer.elapsed();
+
+  // initialize u to some arbitrary value to avoid u being the exact
+  // solution
+  u.resize(b.N());
+  u = 2.0;
+
+  ScalarField rhs(b);
+  Dune::InverseOperatorResult r;
+  timer.reset();
+  solver->apply(u, rhs, r);
+  stats.solveTime = timer.elapsed();
+
+  // the copies get the values of their owners
+  comm.copyOwnerToAll(u, u);
+
+  stats.iterations = r.iterations;
+  stats.converged = r.converged;
+  stats.reduction = r.reduction;
+  return stats;
+}
+
+template<class GV, class F>
+typename ParallelP1Elements<GV, F>::ScalarField ParallelP1Elements<GV, F>::solution() const
+{
+  ScalarField v(localIndex.size());
+  v = 0.0;
+  for (std::size_t k = 0; k < localIndex.size(); k++)
+    if (localIndex[k] >= 0)
+      v[k] = u[localIndex[k]];
+  return v;
+}
+
+#endif // __DUNE_GRID_HOWTO_P1PARALLEL_HH__
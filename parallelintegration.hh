@@ -0,0 +1,122 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_PARALLELINTEGRATION_HH__
+#define __DUNE_GRID_HOWTO_PARALLELINTEGRATION_HH__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <dune/grid/common/partitionset.hh>
+
+#include "integrateentity.hh"
+
+// CompensatedSum:
+// sum of many numbers with the compensation of Neumaier, the rounding
+// error of each addition is accumulated separately and added at the end
+class CompensatedSum
+{
+public:
+  CompensatedSum () : sum_(0.0), compensation_(0.0) {}
+
+  void add (double x)
+  {
+    const double t = sum_ + x;
+    if (std::abs(sum_) >= std::abs(x))
+      compensation_ += (sum_ - t) + x;
+    else
+      compensation_ += (x - t) + sum_;
+    sum_ = t;
+  }
+
+  double value () const
+  {
+    return sum_ + compensation_;
+  }
+
+private:
+  double sum_;
+  double compensation_;
+};
+
+//! sum of x[begin,end) by recursive halving, the rounding error grows
+//! with the logarithm of the number of terms only
+inline double pairwiseSum (const std::vector<double>& x, std::size_t begin, std::size_t end)
+{
+  if (end - begin <= 8)
+  {
+    double sum = 0.0;
+    for (std::size_t i = begin; i < end; i++)
+      sum += x[i];
+    return sum;
+  }
+  const std::size_t middle = begin + (end - begin)/2;
+  return pairwiseSum(x, begin, middle) + pairwiseSum(x, middle, end);
+}
+
+//! integral of f over the interior elements of the grid view with
+//! quadrature order p. The elements are split into chunks of a fixed
+//! size, which are integrated by the given number of threads with
+//! compensated summation. The chunk sums are added pairwise in the order
+//! of the chunks and the sums of the processes in the order of their
+//! ranks, so the result does not depend on the number of threads and is
+//! the same on all processes. The elements are collected on the calling
+//! thread before the threads start, so the threads only read the elements
+//! and their geometries, which the grid implementation has to allow
+//! concurrently.
+template<class GridView, class Function>
+double integrateGridView (const GridView& gridView, const Function& f, int p, int threads = 1)
+{
+  typedef typename GridView::template Codim<0>::Entity Element;
+  typedef typename GridView::ctype ctype;
+
+  // elements per chunk, large enough to amortize the thread overhead
+  const std::size_t chunkSize = 1024;
+
+  std::vector<Element> elementList;
+  elementList.reserve(gridView.size(0));
+  for (const auto& element : elements(gridView, Dune::Partitions::interior))
+    elementList.push_back(element);
+
+  const std::size_t chunks = (elementList.size() + chunkSize - 1) / chunkSize;
+  std::vector<double> chunkSums(chunks, 0.0);
+
+  // thread t integrates the chunks t, t+threads, t+2*threads, ...
+  auto work = [&] (int t)
+  {
+    QuadratureBuffer<ctype,GridView::dimensionworld> buffer;
+    for (std::size_t c = t; c < chunks; c += threads)
+    {
+      CompensatedSum sum;
+      const std::size_t end = std::min(elementList.size(), (c+1)*chunkSize);
+      for (std::size_t k = c*chunkSize; k < end; k++)
+        sum.add(integrateEntity(elementList[k], f, p, buffer));
+      chunkSums[c] = sum.value();
+    }
+  };
+
+  threads = std::max(threads, 1);
+  if (threads == 1)
+    work(0);
+  else
+  {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+      workers.emplace_back(work, t);
+    for (std::thread& worker : workers)
+      worker.join();
+  }
+  double local = pairwiseSum(chunkSums, 0, chunks);
+
+  // combine the sums of all processes in a fixed order
+  const auto& comm = gridView.comm();
+  if (comm.size() == 1)
+    return local;
+  std::vector<double> sums(comm.size());
+  comm.allgather(&local, 1, sums.data());
+  return pairwiseSum(sums, 0, sums.size());
+}
+
+#endif // __DUNE_GRID_HOWTO_PARALLELINTEGRATION_HH__
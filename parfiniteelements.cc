@@ -0,0 +1,125 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#include <config.h>               // know what grids are present
+#include <array>
+#include <iostream>               // for input/output to shell
+#include <memory>
+#include <string>
+#include <dune/common/fvector.hh>
+#include <dune/common/parallel/mpihelper.hh> // include mpi helper class
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
+#include <dune/common/timer.hh>
+#include <dune/grid/io/file/vtk/vtkwriter.hh>
+#include <dune/grid/utility/structuredgridfactory.hh>
+
+#if HAVE_DUNE_ALUGRID
+#include <dune/alugrid/grid.hh>
+#endif
+
+#if HAVE_DUNE_ISTL && HAVE_MPI
+#include "p1parallel.hh"
+#endif
+
+// an example right hand side function
+template<class ctype, int dim>
+class Bump {
+public:
+  ctype operator() (Dune::FieldVector<ctype,dim> x) const
+  {
+    ctype result = 0;
+    for (int i=0 ; i < dim ; i++)
+      result += 2.0 * x[i]* (1-x[i]);
+    return result;
+  }
+};
+
+int main (int argc , char ** argv)
+{
+  // initialize MPI, finalize is done automatically on exit
+  Dune::MPIHelper::instance(argc,argv);
+
+  // start try/catch block to get error messages from dune
+  try {
+#if HAVE_DUNE_ISTL && HAVE_MPI && HAVE_DUNE_ALUGRID
+    // read options like "-solver ilu-cg" from the command line
+    Dune::ParameterTree params;
+    Dune::ParameterTreeParser::readOptions(argc, argv, params);
+    const int cells = params.get<int>("cells", 32);
+    const int refine = params.get<int>("refine", 3);
+    const std::string solverType = params.get<std::string>("solver", "amg-cg");
+    const double reduction = params.get<double>("reduction", 1e-10);
+
+    static const int dim = 2;
+    typedef Dune::ALUGrid<dim,dim,Dune::simplex,Dune::nonconforming> GridType;
+    typedef GridType::LeafGridView GV;
+    typedef GridType::ctype ctype;
+    typedef Bump<ctype,dim> Func;
+
+    // ALUGrid distributes the macro elements, so the unit square is
+    // triangulated with a number of cells first
+    Dune::FieldVector<ctype,dim> lowerLeft(0.0);
+    Dune::FieldVector<ctype,dim> upperRight(1.0);
+    std::array<unsigned int,dim> elements;
+    elements.fill(cells);
+    std::shared_ptr<GridType> grid
+      = Dune::StructuredGridFactory<GridType>::createSimplexGrid(lowerLeft, upperRight, elements);
+
+    // re-partition the grid, then refine it on each process
+    grid->loadBalance();
+    grid->globalRefine(refine);
+
+    const GV gv = grid->leafGridView();
+    const int rank = gv.comm().rank();
+
+    Func f;
+    ParallelP1Elements<GV,Func> p1(gv, f);
+
+    Dune::Timer timer;
+    p1.assemble();
+    const double assemblyTime = gv.comm().max(timer.elapsed());
+
+    const int unknowns = gv.comm().sum(p1.ownedSize());
+    if (rank == 0)
+    {
+      std::cout << "-----------------------------------" << "\n";
+      std::cout << "processes: " << gv.comm().size()
+                << ", number of unknowns: " << unknowns << "\n";
+      std::cout << "assembly time: " << assemblyTime << "s" << "\n";
+      std::cout << "solving with " << solverType << "..." << "\n";
+    }
+
+    auto stats = p1.solve(solverType, reduction);
+    const double setupTime = gv.comm().max(stats.setupTime);
+    const double solveTime = gv.comm().max(stats.solveTime);
+    if (rank == 0)
+    {
+      std::cout << "iterations: " << stats.iterations
+                << (stats.converged ? "" : " (not converged)")
+                << ", reduction: " << stats.reduction << "\n";
+      std::cout << "setup time: " << setupTime << "s"
+                << ", solve time: " << solveTime << "s" << "\n";
+      std::cout << "visualizing..." << "\n";
+    }
+
+    // each process writes its part, rank 0 writes the .pvtu file
+    Dune::VTKWriter<GV> vtkwriter(gv);
+    const auto u = p1.solution();
+    vtkwriter.addVertexData(u, "u");
+    vtkwriter.write("parfem2d", Dune::VTK::appendedraw);
+#else
+    std::cerr << "You need dune-istl, MPI and dune-alugrid for this program." << std::endl;
+#endif
+  }
+  catch (std::exception & e) {
+    std::cout << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+  catch (...) {
+    std::cout << "Unknown ERROR" << std::endl;
+    return 1;
+  }
+
+  // done
+  return 0;
+}
@@ -6,10 +6,12 @@
 #include <vector>                 // STL vector class
 #include <dune/grid/common/mcmgmapper.hh> // mapper class
 #include <dune/common/parallel/mpihelper.hh> // include mpi helper class
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
 
 
 // checks for defined gridtype and inlcudes appropriate dgfparser implementation
-#include "vtkout.hh"
+#include "asyncvtkout.hh"
 #include "unitcube.hh"
 #include "transportproblem2.hh"
 #include "initialize.hh"
@@ -22,7 +24,7 @@
 //===============================================================
 
 template<class G>
-void partimeloop (const G& grid, double tend)
+void partimeloop (const G& grid, double tend, VTKOutputFormat format, bool async)
 {
   // make a mapper for codim 0 entities in the leaf grid
   Dune::LeafMultipleCodimMultipleGeomTypeMapper<G>
@@ -31,9 +33,12 @@ void partimeloop (const G& grid, double tend)
   // allocate a vector for the concentration
   std::vector<double> c(mapper.size());
 
+  // the snapshots, the grid does not change after the first one
+  VTKSnapshotWriter writer("pconc",format,async,grid.comm().rank());
+
   // initialize concentration with initial values
   initialize(grid,mapper,c);
-  vtkout(grid,c,"pconc",0,0.0,grid.comm().rank());
+  writer.write(grid,c,0,0.0);
 
   // now do the time steps
   double t=0,dt;
@@ -56,7 +61,7 @@ void partimeloop (const G& grid, double tend)
     if (t >= saveStep)
     {
       // write data
-      vtkout(grid,c,"pconc",counter,t,grid.comm().rank());
+      writer.write(grid,c,counter,t,false);
 
       //increase counter and saveStep for next interval
       saveStep += saveInterval;
@@ -67,7 +72,10 @@ void partimeloop (const G& grid, double tend)
     if (grid.comm().rank()==0)                         /*@\label{pfc:rank0}@*/
       std::cout << "k=" << k << " t=" << t << " dt=" << dt << std::endl;
   }
-  vtkout(grid,c,"pconc",counter,tend,grid.comm().rank());
+  writer.write(grid,c,counter,tend,false);
+
+  // wait for the snapshots written in the background
+  writer.flush();
 }
 
 //===============================================================
@@ -83,9 +91,16 @@ int main (int argc , char ** argv)
   try {
     using namespace Dune;
 
+    // read the format of the VTK output, e.g. "-vtk zlib", and whether
+    // it is written in the background, "-async 1", from the command line
+    ParameterTree params;
+    ParameterTreeParser::readOptions(argc, argv, params);
+    const VTKOutputFormat format = vtkOutputFormat(params.get<std::string>("vtk", "binary"));
+    const bool async = params.get<bool>("async", false);
+
     UnitCube<YaspGrid<2>,64> uc;
     uc.grid().globalRefine(2);
-    partimeloop(uc.grid(),0.5);
+    partimeloop(uc.grid(),0.5,format,async);
 
     /* To use an alternative grid implementations for parallel computations,
        uncomment exactly one definition of uc2 and the line below. */
@@ -113,7 +128,7 @@ int main (int argc , char ** argv)
     uc2.grid().loadBalance();                               /*@\label{pfv:lb}@*/
 
     // do time loop until end time 0.5
-    partimeloop(uc2.grid(), 0.5);
+    partimeloop(uc2.grid(), 0.5, format, async);
 #endif
 
   }
@@ -0,0 +1,311 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_QKOPERATOR_HH__
+#define __DUNE_GRID_HOWTO_QKOPERATOR_HH__
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fvector.hh>
+#include <dune/geometry/referenceelements.hh>
+#include <dune/grid/common/mcmgmapper.hh>
+#include <dune/istl/operators.hh>
+#include <dune/istl/solvercategory.hh>
+
+#include "qkshapefunctions.hh"
+
+// QkDofMapper:
+// global numbering of the Qk degrees of freedom on a conforming cube
+// grid. The Lagrange nodes in the interior of a subentity of codimension c
+// are attached to it, (k-1)^(dim-c) per subentity. If a subentity holds
+// several nodes, they are ordered by their global coordinates, which
+// does not depend on the orientation of the subentity in the elements
+// sharing it.
+template<class GV, int k>
+class QkDofMapper
+{
+public:
+  static const int dim = GV::dimension;
+  typedef typename GV::ctype ctype;
+  typedef typename GV::template Codim<0>::Entity Element;
+  typedef Dune::MultipleCodimMultipleGeomTypeMapper<GV> Mapper;
+
+  // number of local degrees of freedom
+  enum { size = qkPower(k+1,dim) };
+
+  QkDofMapper (const GV& gv)
+    : gv_(gv), mapper_(gv, [] (Dune::GeometryType gt, int griddim)
+                       {
+                         return std::size_t(qkPower(k-1,gt.dim()));
+                       })
+  {
+    // find the subentity of the reference cube holding each local node: a
+    // coordinate of the node is either fixed to that of the subentity
+    // center or strictly between 0 and 1 where the center is 1/2
+    auto ref = Dune::referenceElement<ctype,dim>(Dune::GeometryTypes::cube(dim));
+    const QkShapeFunctionSet<ctype,ctype,dim,k>& basis = QkShapeFunctionSet<ctype,ctype,dim,k>::instance();
+    for (int l = 0; l < size; l++)
+      for (int c = 0; c <= dim; c++)
+        for (int e = 0; e < ref.size(c); e++)
+        {
+          const Dune::FieldVector<ctype,dim> center = ref.position(e,c);
+          bool inside = true;
+          for (int d = 0; d < dim; d++)
+          {
+            const int i = basis[l].index()[d];
+            inside = inside && ((center[d] == 0.5) ? (i > 0 && i < k) : (i == center[d]*k));
+          }
+          if (inside)
+          {
+            codim_[l] = c;
+            subEntity_[l] = e;
+          }
+        }
+  }
+
+  // total number of degrees of freedom
+  std::size_t globalSize () const
+  {
+    return mapper_.size();
+  }
+
+  // global indices of the local degrees of freedom of an element
+  void indices (const Element& element, int* index) const
+  {
+    for (int l = 0; l < size; l++)
+      index[l] = mapper_.subIndex(element, subEntity_[l], codim_[l]);
+
+    // for k <= 2 each subentity holds at most one node
+    if (k <= 2)
+      return;
+
+    const auto geo = element.geometry();
+    const QkShapeFunctionSet<ctype,ctype,dim,k>& basis = QkShapeFunctionSet<ctype,ctype,dim,k>::instance();
+    Dune::FieldVector<ctype,GV::dimensionworld> x[size];
+    for (int l = 0; l < size; l++)
+    {
+      Dune::FieldVector<ctype,dim> local;
+      for (int d = 0; d < dim; d++)
+        local[d] = LagrangeBasis1D<ctype,k>::node(basis[l].index()[d]);
+      x[l] = geo.global(local);
+    }
+
+    // the offset of a node in its subentity is the number of nodes of the
+    // same subentity before it in lexicographic order of the coordinates
+    const ctype eps = 1e-8 * std::pow(geo.volume(), 1.0/dim);
+    auto before = [&] (int a, int b)
+    {
+      for (int d = GV::dimensionworld-1; d >= 0; d--)
+        if (std::abs(x[a][d] - x[b][d]) > eps)
+          return x[a][d] < x[b][d];
+      return false;
+    };
+    int offset[size];
+    for (int l = 0; l < size; l++)
+    {
+      offset[l] = 0;
+      for (int m = 0; m < size; m++)
+        if (codim_[m] == codim_[l] && subEntity_[m] == subEntity_[l] && before(m,l))
+          offset[l]++;
+    }
+    for (int l = 0; l < size; l++)
+      index[l] += offset[l];
+  }
+
+  // true for the degrees of freedom on the domain boundary
+  std::vector<bool> boundaryDofs () const
+  {
+    const QkShapeFunctionSet<ctype,ctype,dim,k>& basis = QkShapeFunctionSet<ctype,ctype,dim,k>::instance();
+    std::vector<bool> boundary(globalSize(), false);
+    int index[size];
+    for (const auto& element : elements(gv_))
+    {
+      indices(element, index);
+      for (const auto& intersection : intersections(gv_, element))
+        if (intersection.boundary())
+        {
+          // face 2d lies at x_d = 0 and face 2d+1 at x_d = 1
+          const int face = intersection.indexInInside();
+          for (int l = 0; l < size; l++)
+            if (basis[l].index()[face/2] == (face%2)*k)
+              boundary[index[l]] = true;
+        }
+    }
+    return boundary;
+  }
+
+private:
+  const GV& gv_;
+  Mapper mapper_;
+  int codim_[size];
+  int subEntity_[size];
+};
+
+// QkMatrixFreeOperator:
+// applies the Qk stiffness matrix of the Laplacian on a cube grid element
+// by element with the sum-factorized kernel. Rows and columns of
+// Dirichlet degrees of freedom are replaced by the identity. The
+// geometry tensors at the quadrature points are either cached or
+// recomputed in each application.
+template<class GV, class X, int k>
+class QkMatrixFreeOperator : public Dune::LinearOperator<X,X>
+{
+public:
+  typedef X domain_type;
+  typedef X range_type;
+  typedef typename X::field_type field_type;
+
+  static const int dim = GV::dimension;
+
+  typedef typename GV::ctype ctype;
+  typedef QkTensorKernel<ctype,dim,k> Kernel;
+  typedef QkDofMapper<GV,k> DofMapper;
+
+  enum { n = Kernel::size };
+
+  // dirichlet marks the Dirichlet degrees of freedom in the numbering of
+  // the mapper, see QkDofMapper::boundaryDofs()
+  QkMatrixFreeOperator (const GV& gv, const std::vector<bool>& dirichlet,
+                        bool cacheGeometry = true)
+    : gv_(gv), mapper_(gv), dirichlet_(dirichlet), cached_(cacheGeometry)
+  {
+    const Kernel& kernel = Kernel::instance();
+
+    // compute the diagonal for the smoothers and fill the cache
+    diagonal_.assign(mapper_.globalSize(), 0.0);
+    if (cached_)
+    {
+      indices_.reserve(n*gv_.size(0));
+      tensors_.reserve(gv_.size(0));
+    }
+
+    int index[n];
+    typename Kernel::GeometryTensors G;
+    Dune::FieldMatrix<ctype,n,n> localA;
+    for (const auto& element : elements(gv_))
+    {
+      mapper_.indices(element, index);
+      kernel.geometryTensors(element.geometry(), G);
+      kernel.localMatrix(G, localA);
+      for (int i = 0; i < n; i++)
+        diagonal_[index[i]] += localA[i][i];
+      if (cached_)
+      {
+        indices_.insert(indices_.end(), index, index+n);
+        tensors_.push_back(G);
+      }
+    }
+
+    for (std::size_t i = 0; i < diagonal_.size(); i++)
+      if (dirichlet_[i])
+        diagonal_[i] = 1.0;
+  }
+
+  void apply (const X& x, X& y) const override
+  {
+    y = 0.0;
+    applyscaleadd(1.0, x, y);
+  }
+
+  void applyscaleadd (field_type alpha, const X& x, X& y) const override
+  {
+    if (cached_)
+    {
+      for (std::size_t e = 0; e < tensors_.size(); e++)
+        addElement(alpha, &indices_[e*n], tensors_[e], x, y);
+    }
+    else
+    {
+      const Kernel& kernel = Kernel::instance();
+      int index[n];
+      typename Kernel::GeometryTensors G;
+      for (const auto& element : elements(gv_))
+      {
+        mapper_.indices(element, index);
+        kernel.geometryTensors(element.geometry(), G);
+        addElement(alpha, index, G, x, y);
+      }
+    }
+
+    for (std::size_t i = 0; i < dirichlet_.size(); i++)
+      if (dirichlet_[i])
+      {
+        const field_type xi = x[i];
+        y[i] += alpha*xi;
+      }
+  }
+
+  Dune::SolverCategory::Category category () const override
+  {
+    return Dune::SolverCategory::sequential;
+  }
+
+  // b_i = integral of f phi_i, zero on the Dirichlet degrees of freedom
+  template<class Function>
+  void rightHandSide (const Function& f, X& b) const
+  {
+    const Kernel& kernel = Kernel::instance();
+    b.resize(mapper_.globalSize());
+    b = 0.0;
+    int index[n];
+    typename Kernel::Tensor localb;
+    for (const auto& element : elements(gv_))
+    {
+      mapper_.indices(element, index);
+      kernel.rightHandSide(element.geometry(), f, localb);
+      for (int i = 0; i < n; i++)
+        b[index[i]] += localb[i];
+    }
+    for (std::size_t i = 0; i < dirichlet_.size(); i++)
+      if (dirichlet_[i])
+        b[i] = 0.0;
+  }
+
+  const DofMapper& mapper () const
+  {
+    return mapper_;
+  }
+
+  // diagonal of the operator
+  const std::vector<field_type>& diagonal () const
+  {
+    return diagonal_;
+  }
+
+  // bytes held by the operator
+  std::size_t memory () const
+  {
+    return diagonal_.capacity()*sizeof(field_type)
+           + indices_.capacity()*sizeof(int)
+           + tensors_.capacity()*sizeof(typename Kernel::GeometryTensors);
+  }
+
+private:
+  // y += alpha * A_e x
+  void addElement (field_type alpha, const int* index, const typename Kernel::GeometryTensors& G,
+                   const X& x, X& y) const
+  {
+    typename Kernel::Tensor xe, ye;
+    for (int j = 0; j < n; j++)
+    {
+      const field_type xj = x[index[j]];
+      xe[j] = dirichlet_[index[j]] ? 0.0 : xj;
+    }
+    Kernel::instance().applyLaplacian(G, xe, ye);
+    for (int i = 0; i < n; i++)
+      if (!dirichlet_[index[i]])
+        y[index[i]] += alpha*ye[i];
+  }
+
+  const GV& gv_;
+  DofMapper mapper_;
+  const std::vector<bool>& dirichlet_;
+  bool cached_;
+  std::vector<field_type> diagonal_;
+  std::vector<int> indices_;
+  std::vector<typename Kernel::GeometryTensors> tensors_;
+};
+
+#endif // __DUNE_GRID_HOWTO_QKOPERATOR_HH__
@@ -0,0 +1,387 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef __DUNE_GRID_HOWTO_QKSHAPEFUNCTIONS_HH__
+#define __DUNE_GRID_HOWTO_QKSHAPEFUNCTIONS_HH__
+
+#include <array>
+#include <cmath>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fmatrix.hh>
+#include <dune/common/fvector.hh>
+#include <dune/geometry/quadraturerules.hh>
+#include <dune/geometry/type.hh>
+
+#include "affinegeometry.hh"
+
+//! b to the power of e at compile time
+constexpr int qkPower (int b, int e)
+{
+  return (e == 0) ? 1 : b*qkPower(b,e-1);
+}
+
+// LagrangeBasis1D:
+// Lagrange polynomials of degree k on [0,1] with equidistant nodes i/k
+template<class ctype, int k>
+class LagrangeBasis1D
+{
+public:
+  static ctype node (int i)
+  {
+    return ctype(i)/k;
+  }
+
+  static ctype value (int i, ctype x)
+  {
+    ctype result = 1.0;
+    for (int j = 0; j <= k; j++)
+      if (j != i)
+        result *= (x - node(j))/(node(i) - node(j));
+    return result;
+  }
+
+  static ctype derivative (int i, ctype x)
+  {
+    ctype result = 0.0;
+    for (int m = 0; m <= k; m++)
+    {
+      if (m == i)
+        continue;
+      ctype product = 1.0/(node(i) - node(m));
+      for (int j = 0; j <= k; j++)
+        if (j != i && j != m)
+          product *= (x - node(j))/(node(i) - node(j));
+      result += product;
+    }
+    return result;
+  }
+};
+
+// TensorProductShapeFunction:
+// product of one dimensional Lagrange polynomials, one per direction
+template<class ctype, class rtype, int dim, int k>
+class TensorProductShapeFunction
+{
+public:
+  enum { dimension = dim };
+
+  typedef LagrangeBasis1D<rtype,k> Basis1D;
+
+  TensorProductShapeFunction () {}
+
+  explicit TensorProductShapeFunction (int index)
+  {
+    for (int d = 0; d < dim; d++, index /= k+1)
+      multiindex[d] = index % (k+1);
+  }
+
+  rtype evaluateFunction (const Dune::FieldVector<ctype,dim>& local) const
+  {
+    rtype result = 1.0;
+    for (int d = 0; d < dim; d++)
+      result *= Basis1D::value(multiindex[d],local[d]);
+    return result;
+  }
+
+  Dune::FieldVector<rtype,dim>
+  evaluateGradient (const Dune::FieldVector<ctype,dim>& local) const
+  {
+    Dune::FieldVector<rtype,dim> result(1.0);
+    for (int d = 0; d < dim; d++)
+      for (int j = 0; j < dim; j++)
+        result[d] *= (j == d) ? Basis1D::derivative(multiindex[j],local[j])
+                              : Basis1D::value(multiindex[j],local[j]);
+    return result;
+  }
+
+  // the position of the Lagrange node in each direction
+  const std::array<int,dim>& index () const
+  {
+    return multiindex;
+  }
+
+private:
+  std::array<int,dim> multiindex;
+};
+
+// QkShapeFunctionSet:
+// the (k+1)^dim tensor-product Lagrange shape functions of degree k on the
+// reference cube. They are numbered lexicographically with the first
+// direction running fastest, so for k=1 the numbering is the one of the
+// vertices of the reference cube.
+template<class ctype, class rtype, int dim, int k>
+class QkShapeFunctionSet
+{
+public:
+  enum { n = qkPower(k+1,dim) };
+
+  typedef TensorProductShapeFunction<ctype,rtype,dim,k> ShapeFunction;
+  typedef rtype resulttype;
+
+  // get the only instance of this class
+  static const QkShapeFunctionSet& instance ()
+  {
+    static const QkShapeFunctionSet sfs;
+    return sfs;
+  }
+
+  const ShapeFunction& operator[] (int i) const
+  {
+    return f[i];
+  }
+
+private:
+  // private constructor prevents additional instances
+  QkShapeFunctionSet ()
+  {
+    for (int i = 0; i < n; i++)
+      f[i] = ShapeFunction(i);
+  }
+
+  QkShapeFunctionSet (const QkShapeFunctionSet& other)
+  {}
+
+  ShapeFunction f[n];
+};
+
+// QkTensorKernel:
+// sum-factorized evaluation of Qk functions on the tensor-product Gauss
+// rule with k+1 points per direction. Values or gradients at all
+// quadrature points are obtained by applying a small one dimensional
+// matrix in each direction in turn, which costs O(dim k^(dim+1)) instead
+// of O(k^(2dim)) for the evaluation of each shape function at each point.
+// The transposed operations integrate against all shape functions.
+template<class ctype, int dim, int k>
+class QkTensorKernel
+{
+public:
+  // number of shape functions and quadrature points per direction and
+  // in total, both coincide
+  enum { n1 = k+1 };
+  enum { size = qkPower(n1,dim) };
+
+  typedef std::array<ctype,size> Tensor;
+  typedef Dune::FieldMatrix<ctype,dim,dim> GeometryTensor;
+
+  // per quadrature point weight * integration element * J^{-1} J^{-T},
+  // the stiffness matrix is then the sum of gradients^T G gradients
+  typedef std::array<GeometryTensor,size> GeometryTensors;
+
+  // get the only instance of this class
+  static const QkTensorKernel& instance ()
+  {
+    static const QkTensorKernel kernel;
+    return kernel;
+  }
+
+  const Dune::FieldVector<ctype,dim>& position (int p) const
+  {
+    return positions_[p];
+  }
+
+  ctype weight (int p) const
+  {
+    return weights_[p];
+  }
+
+  // values of the function with the coefficients c at the quadrature points
+  void values (const Tensor& c, Tensor& v) const
+  {
+    Tensor tmp = c;
+    for (int d = 0; d < dim; d++)
+    {
+      contract(values_, false, d, tmp, v);
+      tmp = v;
+    }
+  }
+
+  // gradients on the reference element at the quadrature points
+  void gradients (const Tensor& c, std::array<Tensor,dim>& g) const
+  {
+    for (int d = 0; d < dim; d++)
+    {
+      Tensor tmp = c;
+      for (int j = 0; j < dim; j++)
+      {
+        contract((j == d) ? derivatives_ : values_, false, j, tmp, g[d]);
+        tmp = g[d];
+      }
+    }
+  }
+
+  // r_i = sum_p v_p phi_i(x_p)
+  void integrateValues (const Tensor& v, Tensor& r) const
+  {
+    Tensor tmp = v;
+    for (int d = 0; d < dim; d++)
+    {
+      contract(values_, true, d, tmp, r);
+      tmp = r;
+    }
+  }
+
+  // r_i = sum_p sum_d g_d,p dphi_i/dx_d(x_p)
+  void integrateGradients (const std::array<Tensor,dim>& g, Tensor& r) const
+  {
+    r.fill(0.0);
+    for (int d = 0; d < dim; d++)
+    {
+      Tensor tmp = g[d], out;
+      for (int j = 0; j < dim; j++)
+      {
+        contract((j == d) ? derivatives_ : values_, true, j, tmp, out);
+        tmp = out;
+      }
+      for (int i = 0; i < size; i++)
+        r[i] += tmp[i];
+    }
+  }
+
+  // the geometry tensors of an element at the quadrature points
+  template<class Geometry>
+  void geometryTensors (const Geometry& geo, GeometryTensors& G) const
+  {
+    // on affine elements the tensors only differ by the weights
+    AffineGeometryCache<ctype,dim,Geometry::coorddimension> affine;
+    if (affine.bind(geo))
+    {
+      GeometryTensor G0;
+      const auto& jacInvTra = affine.jacobianInverseTransposed();
+      for (int i = 0; i < dim; i++)
+        for (int j = 0; j < dim; j++)
+        {
+          G0[i][j] = 0.0;
+          for (int c = 0; c < Geometry::coorddimension; c++)
+            G0[i][j] += jacInvTra[c][i] * jacInvTra[c][j];
+          G0[i][j] *= affine.integrationElement();
+        }
+      for (int p = 0; p < size; p++)
+        for (int i = 0; i < dim; i++)
+          for (int j = 0; j < dim; j++)
+            G[p][i][j] = weights_[p] * G0[i][j];
+      return;
+    }
+
+    for (int p = 0; p < size; p++)
+    {
+      // transformed gradients of the reference coordinates
+      const auto jacInvTra = geo.jacobianInverseTransposed(positions_[p]);
+      const ctype factor = weights_[p] * geo.integrationElement(positions_[p]);
+      Dune::FieldVector<ctype,Geometry::coorddimension> grad[dim];
+      for (int i = 0; i < dim; i++)
+      {
+        Dune::FieldVector<ctype,dim> e(0.0);
+        e[i] = 1.0;
+        jacInvTra.mv(e, grad[i]);
+      }
+      for (int i = 0; i < dim; i++)
+        for (int j = 0; j < dim; j++)
+          G[p][i][j] = factor * (grad[i]*grad[j]);
+    }
+  }
+
+  // y = A_e x for the element stiffness matrix of the Laplacian
+  void applyLaplacian (const GeometryTensors& G, const Tensor& x, Tensor& y) const
+  {
+    std::array<Tensor,dim> g, h;
+    gradients(x, g);
+    for (int p = 0; p < size; p++)
+      for (int i = 0; i < dim; i++)
+      {
+        h[i][p] = 0.0;
+        for (int j = 0; j < dim; j++)
+          h[i][p] += G[p][i][j] * g[j][p];
+      }
+    integrateGradients(h, y);
+  }
+
+  // the element stiffness matrix, column by column
+  template<class LocalMatrix>
+  void localMatrix (const GeometryTensors& G, LocalMatrix& A) const
+  {
+    Tensor x, y;
+    x.fill(0.0);
+    for (int j = 0; j < size; j++)
+    {
+      x[j] = 1.0;
+      applyLaplacian(G, x, y);
+      x[j] = 0.0;
+      for (int i = 0; i < size; i++)
+        A[i][j] = y[i];
+    }
+  }
+
+  // b_i = integral of f phi_i over the element
+  template<class Geometry, class Function, class LocalVector>
+  void rightHandSide (const Geometry& geo, const Function& f, LocalVector& b) const
+  {
+    Tensor v, r;
+    AffineGeometryCache<ctype,dim,Geometry::coorddimension> affine;
+    if (affine.bind(geo))
+      for (int p = 0; p < size; p++)
+        v[p] = weights_[p] * affine.integrationElement() * f(affine.global(positions_[p]));
+    else
+      for (int p = 0; p < size; p++)
+        v[p] = weights_[p] * geo.integrationElement(positions_[p]) * f(geo.global(positions_[p]));
+    integrateValues(v, r);
+    for (int i = 0; i < size; i++)
+      b[i] = r[i];
+  }
+
+private:
+  QkTensorKernel ()
+  {
+    // Gauss points on [0,1], exact for polynomials of degree 2k+1
+    const Dune::QuadratureRule<ctype,1>& rule
+      = Dune::QuadratureRules<ctype,1>::rule(Dune::GeometryTypes::line, 2*k+1);
+    if (int(rule.size()) != n1)
+      DUNE_THROW(Dune::Exception, "no Gauss rule with " << n1 << " points");
+
+    // one dimensional shape functions and derivatives at the points
+    for (int q = 0; q < n1; q++)
+      for (int i = 0; i < n1; i++)
+      {
+        values_[q*n1+i] = LagrangeBasis1D<ctype,k>::value(i, rule[q].position()[0]);
+        derivatives_[q*n1+i] = LagrangeBasis1D<ctype,k>::derivative(i, rule[q].position()[0]);
+      }
+
+    // tensor-product points, numbered like the shape functions
+    for (int p = 0; p < size; p++)
+    {
+      weights_[p] = 1.0;
+      for (int d = 0, index = p; d < dim; d++, index /= n1)
+      {
+        positions_[p][d] = rule[index % n1].position()[0];
+        weights_[p] *= rule[index % n1].weight();
+      }
+    }
+  }
+
+  QkTensorKernel (const QkTensorKernel& other)
+  {}
+
+  // apply the matrix M (point q times function i), or its transpose, in
+  // direction d of the tensor in
+  static void contract (const std::array<ctype,n1*n1>& M, bool transpose, int d,
+                        const Tensor& in, Tensor& out)
+  {
+    const int stride = qkPower(n1,d);
+    const int outer = size/(stride*n1);
+    for (int o = 0; o < outer; o++)
+      for (int i = 0; i < n1; i++)
+        for (int s = 0; s < stride; s++)
+        {
+          ctype sum = 0.0;
+          for (int j = 0; j < n1; j++)
+            sum += (transpose ? M[j*n1+i] : M[i*n1+j]) * in[(o*n1+j)*stride+s];
+          out[(o*n1+i)*stride+s] = sum;
+        }
+  }
+
+  std::array<ctype,n1*n1> values_;
+  std::array<ctype,n1*n1> derivatives_;
+  std::array<Dune::FieldVector<ctype,dim>,size> positions_;
+  std::array<ctype,size> weights_;
+};
+
+#endif // __DUNE_GRID_HOWTO_QKSHAPEFUNCTIONS_HH__
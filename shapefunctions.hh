@@ -3,7 +3,14 @@
 #ifndef SHAPEFUNCTIONS_HH
 #define SHAPEFUNCTIONS_HH
 
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #include <dune/common/fvector.hh>
+#include <dune/geometry/quadraturerules.hh>
+#include <dune/geometry/type.hh>
 
 // LinearShapeFunction:
 // represents a shape function and provides methods to evaluate the function
@@ -44,6 +51,68 @@ private:
   Dune::FieldVector<rtype,dim> coeff1;
 };
 
+// ShapeFunctionTable:
+// values and gradients of all functions of a shape function set at all
+// points of a quadrature rule, stored contiguously point by point
+template<class ctype, class rtype, int dim>
+class ShapeFunctionTable
+{
+public:
+  template<class ShapeFunctionSet>
+  ShapeFunctionTable (const ShapeFunctionSet& set, const Dune::QuadratureRule<ctype,dim>& rule)
+    : n_(ShapeFunctionSet::n)
+  {
+    positions_.reserve(rule.size());
+    weights_.reserve(rule.size());
+    values_.reserve(rule.size()*n_);
+    gradients_.reserve(rule.size()*n_);
+    for (const auto& qp : rule)
+    {
+      positions_.push_back(qp.position());
+      weights_.push_back(qp.weight());
+      for (int i = 0; i < n_; i++)
+      {
+        values_.push_back(set[i].evaluateFunction(qp.position()));
+        gradients_.push_back(set[i].evaluateGradient(qp.position()));
+      }
+    }
+  }
+
+  int size () const
+  {
+    return weights_.size();
+  }
+
+  const Dune::FieldVector<ctype,dim>& position (int q) const
+  {
+    return positions_[q];
+  }
+
+  ctype weight (int q) const
+  {
+    return weights_[q];
+  }
+
+  // the values of all shape functions at point q
+  const rtype* values (int q) const
+  {
+    return values_.data() + q*n_;
+  }
+
+  // the gradients of all shape functions at point q
+  const Dune::FieldVector<rtype,dim>* gradients (int q) const
+  {
+    return gradients_.data() + q*n_;
+  }
+
+private:
+  int n_;
+  std::vector<Dune::FieldVector<ctype,dim> > positions_;
+  std::vector<ctype> weights_;
+  std::vector<rtype> values_;
+  std::vector<Dune::FieldVector<rtype,dim> > gradients_;
+};
+
 // P1ShapeFunctionSet
 // initializes one and only one set of LinearShapeFunction
 template<class ctype, class rtype, int dim>
@@ -53,6 +122,7 @@ public:
   enum { n = dim + 1 };
 
   typedef LinearShapeFunction<ctype,rtype,dim> ShapeFunction;
+  typedef ShapeFunctionTable<ctype,rtype,dim> Table;
   typedef rtype resulttype;
 
   // get the only instance of this class
@@ -70,6 +140,19 @@ public:
       return f1[i - 1];
   }
 
+  // values and gradients at the points of the quadrature rule of the given
+  // type and order, the table is computed on the first request and kept
+  // for the lifetime of the program
+  const Table& table(const Dune::GeometryType& gt, int order) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::pair<unsigned int,int> key(gt.id(), order);
+    auto it = tables.find(key);
+    if (it == tables.end())
+      it = tables.emplace(key, Table(*this, Dune::QuadratureRules<ctype,dim>::rule(gt,order))).first;
+    return it->second;
+  }
+
 private:
   // private constructor prevents additional instances
   P1ShapeFunctionSet()
@@ -89,6 +172,9 @@ private:
 
   ShapeFunction f0;
   ShapeFunction f1[dim];
+
+  mutable std::mutex mutex;
+  mutable std::map<std::pair<unsigned int,int>,Table> tables;
 };
 
 #endif
@@ -3,26 +3,93 @@
 #ifndef __DUNE_GRID_HOWTO_VTKOUT_HH__
 #define __DUNE_GRID_HOWTO_VTKOUT_HH__
 
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <dune/common/exceptions.hh>
+#include <dune/common/timer.hh>
 #include <dune/grid/io/file/vtk/vtkwriter.hh>
 #include <stdio.h>
 
+#include "compressedvtkwriter.hh"
+
+// format of the files written by vtkout(): text, appended raw binary
+// data or appended binary data compressed by zlib
+enum class VTKOutputFormat { ascii, binary, zlib };
+
+//! the format with the given name, e.g. from the command line
+inline VTKOutputFormat vtkOutputFormat (const std::string& name)
+{
+  if (name == "ascii")
+    return VTKOutputFormat::ascii;
+  if (name == "binary")
+    return VTKOutputFormat::binary;
+  if (name == "zlib")
+    return VTKOutputFormat::zlib;
+  DUNE_THROW(Dune::Exception, "unknown VTK output format " << name);
+}
+
+// size of the files written by one call of vtkout(), summed over all
+// processes, and the time of the slowest process
+struct VTKOutputStatistics
+{
+  long bytes;
+  double seconds;
+};
+
+//! size of a file in bytes, 0 if it does not exist
+inline long fileBytes (const std::string& fileName)
+{
+  std::ifstream file(fileName, std::ios_base::binary | std::ios_base::ate);
+  return file ? static_cast<long>(file.tellg()) : 0;
+}
+
 template<class G, class V>
-void vtkout (const G& grid, const V& c, const char* name, int k, double time=0.0, int rank=0)
+VTKOutputStatistics vtkout (const G& grid, const V& c, const char* name, int k, double time=0.0,
+                            int rank=0, VTKOutputFormat format=VTKOutputFormat::binary)
 {
-  Dune::VTKWriter<typename G::LeafGridView> vtkwriter(grid.leafGridView());
+  Dune::Timer timer;
   char fname[128];
   char sername[128];
   sprintf(fname,"%s-%05d",name,k);
   sprintf(sername,"%s.series",name);
-  vtkwriter.addCellData(c,"celldata");
-  vtkwriter.write( fname, Dune::VTK::ascii );
+  if (format == VTKOutputFormat::zlib)
+    writeCompressedVTU(grid.leafGridView(),c,"celldata",fname);
+  else
+  {
+    Dune::VTKWriter<typename G::LeafGridView> vtkwriter(grid.leafGridView());
+    vtkwriter.addCellData(c,"celldata");
+    vtkwriter.write( fname, (format == VTKOutputFormat::ascii)
+                     ? Dune::VTK::ascii : Dune::VTK::appendedraw );
+  }
+
+  // the files of this process, Dune::VTKWriter writes polydata in 1d
+  const auto& comm = grid.comm();
+  const bool polydata = (G::dimension == 1 && format != VTKOutputFormat::zlib);
+  const char* extension = polydata ? ".vtp" : ".vtu";
+  VTKOutputStatistics stats;
+  if (comm.size() == 1)
+    stats.bytes = fileBytes(std::string(fname) + extension);
+  else
+  {
+    stats.bytes = fileBytes(vtkPieceName(fname, comm.rank(), comm.size(), extension));
+    if (comm.rank() == 0)
+      stats.bytes += fileBytes(vtkParallelHeaderName(fname, comm.size(),
+                                                     polydata ? ".pvtp" : ".pvtu"));
+  }
+  stats.bytes = comm.sum(stats.bytes);
+  stats.seconds = comm.max(timer.elapsed());
 
   if ( rank == 0)
   {
     std::ofstream serstream(sername, (k==0 ? std::ios_base::out : std::ios_base::app));
     serstream << k << " " << fname << ".vtu " << time << std::endl;
     serstream.close();
+    std::cout << "vtkout " << fname << " bytes=" << stats.bytes
+              << " seconds=" << stats.seconds << std::endl;
   }
+  return stats;
 }
 
 #endif // __DUNE_GRID_HOWTO_VTKOUT_HH__